@@ -3,6 +3,7 @@ add_library(usermod_tlc5947 INTERFACE)
 target_sources(usermod_tlc5947 INTERFACE
   ${CMAKE_CURRENT_LIST_DIR}/tlc5947/tlc5947.c
   ${CMAKE_CURRENT_LIST_DIR}/tlc5947/color.c
+  ${CMAKE_CURRENT_LIST_DIR}/tlc5947/transfer.c
 )
 
 target_include_directories(usermod_tlc5947 INTERFACE
@@ -3,3 +3,4 @@ TLC5947_MOD_DIR := $(USERMOD_DIR)
 # Add all C files to SRC_USERMOD
 SRC_USERMOD += $(TLC5947_MOD_DIR)/tlc5947/tlc5947.c
 SRC_USERMOD += $(TLC5947_MOD_DIR)/tlc5947/color.c
+SRC_USERMOD += $(TLC5947_MOD_DIR)/tlc5947/transfer.c
@@ -0,0 +1,16 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/extmod/modmachine.h
+ * @brief  host replacement of the machine module, only the SPI protocol
+ */
+#ifndef TEST_HOST_EXTMOD_MODMACHINE_H
+#define TEST_HOST_EXTMOD_MODMACHINE_H
+
+#include "py/obj.h"
+
+typedef struct _mp_machine_spi_p_t{
+    void (*transfer)(mp_obj_base_t* obj, size_t len, const uint8_t* src, uint8_t* dest);
+}mp_machine_spi_p_t;
+
+mp_obj_base_t* mp_hal_get_spi_obj(mp_obj_t spi_in);
+
+#endif /* TEST_HOST_EXTMOD_MODMACHINE_H */
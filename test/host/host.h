@@ -0,0 +1,26 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/host.h
+ * @brief  helpers for the host side tests
+ */
+#ifndef TEST_HOST_HOST_H
+#define TEST_HOST_HOST_H
+
+#include <setjmp.h>
+
+#include "py/obj.h"
+
+extern jmp_buf host_exception;
+extern const char* host_exception_text;
+
+/**
+ * runs the following statement, an exception raised by the module
+ * continues with the else branch, host_exception_text has the message.
+ */
+#define host_try if(!setjmp(host_exception))
+
+mp_obj_t host_str(const char* str);
+mp_obj_t host_float(mp_float_t value);
+
+extern mp_map_t host_no_kw;
+
+#endif /* TEST_HOST_HOST_H */
@@ -0,0 +1,14 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/py/mpconfig.h
+ * @brief  host replacement of the micropython configuration
+ */
+#ifndef TEST_HOST_PY_MPCONFIG_H
+#define TEST_HOST_PY_MPCONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NORETURN __attribute__((noreturn))
+
+#endif /* TEST_HOST_PY_MPCONFIG_H */
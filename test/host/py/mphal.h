@@ -0,0 +1,29 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/py/mphal.h
+ * @brief  host replacement of the micropython hardware abstraction
+ *
+ * The pins are plain integers, set by the module and never read back.
+ */
+#ifndef TEST_HOST_PY_MPHAL_H
+#define TEST_HOST_PY_MPHAL_H
+
+#include "py/obj.h"
+
+typedef int* mp_hal_pin_obj_t;
+#define MP_HAL_PIN_FMT "%p"
+
+mp_hal_pin_obj_t mp_hal_get_pin_obj(mp_obj_t pin_in);
+
+static inline void mp_hal_pin_write(mp_hal_pin_obj_t pin, int value){
+    *pin = value;
+}
+
+static inline void mp_hal_pin_low(mp_hal_pin_obj_t pin){
+    *pin = 0;
+}
+
+static inline void mp_hal_pin_high(mp_hal_pin_obj_t pin){
+    *pin = 1;
+}
+
+#endif /* TEST_HOST_PY_MPHAL_H */
@@ -0,0 +1,185 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/py/obj.h
+ * @brief  host replacement of the micropython object model
+ *
+ * Only the parts used by the module are provided, small ints are tagged
+ * like in micropython, every other object starts with mp_obj_base_t.
+ */
+#ifndef TEST_HOST_PY_OBJ_H
+#define TEST_HOST_PY_OBJ_H
+
+#include "py/mpconfig.h"
+
+typedef void* mp_obj_t;
+typedef const void* mp_const_obj_t;
+// like on the 32 bit ports the module is written for
+typedef int mp_int_t;
+typedef unsigned int mp_uint_t;
+typedef float mp_float_t;
+typedef size_t qstr;
+
+// the qstr's of the module, qstrdefs.h is generated by the Makefile
+enum{
+    MP_QSTRnull,
+#define QDEF(id) MP_QSTR_##id,
+#include "qstrdefs.h"
+#undef QDEF
+    MP_QSTRnumber_of,
+};
+
+qstr qstr_find_strn(const char* str, size_t len);
+qstr qstr_from_strn(const char* str, size_t len);
+const char* qstr_str(qstr q);
+
+typedef struct _mp_obj_type_t mp_obj_type_t;
+
+typedef struct _mp_obj_base_t{
+    const mp_obj_type_t* type;
+}mp_obj_base_t;
+
+struct _mp_obj_type_t{
+    mp_obj_base_t base;
+    const void* protocol;
+};
+
+typedef struct _mp_print_t mp_print_t;
+typedef enum{
+    PRINT_STR,
+    PRINT_REPR,
+}mp_print_kind_t;
+
+typedef struct _mp_map_elem_t{
+    mp_obj_t key;
+    mp_obj_t value;
+}mp_map_elem_t;
+typedef mp_map_elem_t mp_rom_map_elem_t;
+
+typedef struct _mp_map_t{
+    size_t alloc;
+    size_t used;
+    mp_map_elem_t* table;
+}mp_map_t;
+
+typedef enum{
+    MP_MAP_LOOKUP,
+}mp_map_lookup_kind_t;
+
+typedef struct _mp_obj_dict_t{
+    mp_obj_base_t base;
+}mp_obj_dict_t;
+
+typedef struct _mp_obj_module_t{
+    mp_obj_base_t base;
+    mp_obj_dict_t* globals;
+}mp_obj_module_t;
+
+typedef struct _mp_buffer_info_t{
+    void* buf;
+    size_t len;
+    int typecode;
+}mp_buffer_info_t;
+
+#define MP_BUFFER_READ  (1)
+#define MP_BUFFER_WRITE (2)
+#define MP_BUFFER_RW    (MP_BUFFER_READ | MP_BUFFER_WRITE)
+
+#define MP_OBJ_NULL              ((mp_obj_t)0)
+#define MP_OBJ_SENTINEL          ((mp_obj_t)4)
+#define MP_OBJ_TO_PTR(o)         ((void*)(o))
+#define MP_OBJ_FROM_PTR(p)       ((mp_obj_t)(p))
+#define MP_OBJ_NEW_SMALL_INT(i)  ((mp_obj_t)((((intptr_t)(i)) * 2) | 1))
+#define MP_OBJ_SMALL_INT_VALUE(o) ((mp_int_t)(((intptr_t)(o)) >> 1))
+#define MP_OBJ_NEW_QSTR(q)       ((mp_obj_t)((((uintptr_t)(q)) << 3) | 2))
+#define MP_OBJ_QSTR_VALUE(o)     ((qstr)(((uintptr_t)(o)) >> 3))
+#define MP_ROM_QSTR(q)           MP_OBJ_NEW_QSTR(q)
+#define MP_ROM_INT(i)            MP_OBJ_NEW_SMALL_INT(i)
+#define MP_ROM_PTR(p)            ((mp_obj_t)(p))
+
+#define mp_obj_is_small_int(o) ((((uintptr_t)(o)) & 1) != 0)
+#define mp_obj_is_int(o)       mp_obj_is_small_int(o)
+#define mp_obj_is_qstr(o)      ((((uintptr_t)(o)) & 7) == 2)
+#define mp_obj_is_obj(o)       ((((uintptr_t)(o)) & 3) == 0)
+#define mp_obj_is_type(o, t)   (mp_obj_is_obj(o) && (o) && (((mp_obj_base_t*)(o))->type == (t)))
+#define mp_obj_is_str(o)       (mp_obj_is_qstr(o) || mp_obj_is_type(o, &mp_type_str))
+#define mp_obj_is_float(o)     mp_obj_is_type(o, &mp_type_float)
+
+#define MP_ERROR_TEXT(s) s
+typedef const char* mp_rom_error_text_t;
+
+#define MP_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define MP_OBJ_TYPE_GET_SLOT(t, f) ((t)->f)
+
+// the function objects are never called through micropython on the host
+#define MP_DEFINE_CONST_FUN_OBJ_0(n, f)                 const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_1(n, f)                 const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_2(n, f)                 const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_3(n, f)                 const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_VAR(n, min, f)          const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(n, a, b, f) const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_FUN_OBJ_KW(n, min, f)           const void* const n = (const void*)(f)
+#define MP_DEFINE_CONST_DICT(n, t)                      const void* const n = (const void*)(t)
+#define MP_DEFINE_CONST_OBJ_TYPE(n, ...)                const mp_obj_type_t n = {{NULL}, NULL}
+#define MP_REGISTER_MODULE(name, module)
+#define MP_TYPE_FLAG_NONE (0)
+
+extern const mp_obj_base_t mp_const_none_obj;
+extern const mp_obj_base_t mp_const_false_obj;
+extern const mp_obj_base_t mp_const_true_obj;
+#define mp_const_none  ((mp_obj_t)&mp_const_none_obj)
+#define mp_const_false ((mp_obj_t)&mp_const_false_obj)
+#define mp_const_true  ((mp_obj_t)&mp_const_true_obj)
+
+extern const mp_obj_type_t mp_type_module;
+extern const mp_obj_type_t mp_type_str;
+extern const mp_obj_type_t mp_type_float;
+extern const mp_obj_type_t mp_type_list;
+extern const mp_obj_type_t mp_type_tuple;
+extern const mp_obj_type_t mp_type_dict;
+extern const mp_obj_type_t mp_type_AttributeError;
+extern const mp_obj_type_t mp_type_NotImplementedError;
+extern const mp_obj_type_t mp_type_TypeError;
+extern const mp_obj_type_t mp_type_ValueError;
+
+void* m_malloc(size_t num_bytes);
+void* m_malloc0(size_t num_bytes);
+void* m_malloc_maybe(size_t num_bytes);
+void* m_realloc(void* ptr, size_t new_num_bytes);
+void* m_realloc_maybe(void* ptr, size_t new_num_bytes, bool allow_move);
+void m_free(void* ptr);
+NORETURN void m_malloc_fail(size_t num_bytes);
+
+#define m_new(type, num)  ((type*)m_malloc(sizeof(type) * (num)))
+#define m_new0(type, num) ((type*)m_malloc0(sizeof(type) * (num)))
+#define m_new_obj(type)   m_new(type, 1)
+#define m_del(type, ptr, num) m_free(ptr)
+#define mp_obj_malloc(struct_type, obj_type) \
+    ({ struct_type* _o = m_new_obj(struct_type); _o->base.type = (obj_type); _o; })
+
+mp_obj_t mp_obj_new_bool(mp_int_t value);
+mp_obj_t mp_obj_new_int(mp_int_t value);
+mp_obj_t mp_obj_new_int_from_ull(unsigned long long value);
+mp_obj_t mp_obj_new_float(mp_float_t value);
+mp_obj_t mp_obj_new_str(const char* data, size_t len);
+mp_obj_t mp_obj_new_tuple(size_t n, const mp_obj_t* items);
+
+bool mp_obj_is_true(mp_obj_t arg);
+mp_int_t mp_obj_get_int(mp_const_obj_t arg);
+bool mp_obj_get_int_maybe(mp_const_obj_t arg, mp_int_t* value);
+mp_float_t mp_obj_get_float(mp_obj_t self_in);
+bool mp_obj_get_float_maybe(mp_obj_t arg, mp_float_t* value);
+void mp_obj_get_array(mp_obj_t o, size_t* len, mp_obj_t** items);
+void mp_obj_get_array_fixed_n(mp_obj_t o, size_t len, mp_obj_t** items);
+const char* mp_obj_str_get_str(mp_obj_t self_in);
+const char* mp_obj_str_get_data(mp_obj_t self_in, size_t* len);
+qstr mp_obj_str_get_qstr(mp_obj_t self_in);
+
+bool mp_get_buffer(mp_obj_t obj, mp_buffer_info_t* bufinfo, mp_uint_t flags);
+void mp_get_buffer_raise(mp_obj_t obj, mp_buffer_info_t* bufinfo, mp_uint_t flags);
+
+mp_map_elem_t* mp_map_lookup(mp_map_t* map, mp_obj_t index, mp_map_lookup_kind_t lookup_kind);
+#define mp_map_slot_is_filled(map, pos) ((map)->table[pos].key != MP_OBJ_NULL)
+
+int mp_printf(const mp_print_t* print, const char* fmt, ...);
+
+#endif /* TEST_HOST_PY_OBJ_H */
@@ -0,0 +1,50 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/py/runtime.h
+ * @brief  host replacement of the micropython runtime
+ */
+#ifndef TEST_HOST_PY_RUNTIME_H
+#define TEST_HOST_PY_RUNTIME_H
+
+#include "py/obj.h"
+
+NORETURN void mp_raise_msg(const mp_obj_type_t* exc_type, mp_rom_error_text_t msg);
+NORETURN void mp_raise_ValueError(mp_rom_error_text_t msg);
+NORETURN void mp_raise_TypeError(mp_rom_error_text_t msg);
+
+typedef union _mp_arg_val_t{
+    bool u_bool;
+    mp_int_t u_int;
+    mp_obj_t u_obj;
+}mp_arg_val_t;
+
+typedef struct _mp_arg_t{
+    uint16_t qst;
+    uint16_t flags;
+    mp_arg_val_t defval;
+}mp_arg_t;
+
+#define MP_ARG_BOOL     (0x001)
+#define MP_ARG_INT      (0x002)
+#define MP_ARG_OBJ      (0x003)
+#define MP_ARG_KIND_MASK (0x0ff)
+#define MP_ARG_REQUIRED (0x100)
+#define MP_ARG_KW_ONLY  (0x200)
+
+void mp_arg_check_num(size_t n_args, size_t n_kw, size_t n_args_min, size_t n_args_max, bool takes_kw);
+void mp_arg_parse_all(size_t n_pos, const mp_obj_t* pos, mp_map_t* kws, size_t n_allowed,
+                      const mp_arg_t* allowed, mp_arg_val_t* out_vals);
+
+// exceptions are not caught inside of the module, see host_try()
+typedef struct _nlr_buf_t{
+    int unused;
+}nlr_buf_t;
+
+static inline unsigned int nlr_push(nlr_buf_t* nlr){
+    (void)nlr;
+    return 0;
+}
+
+static inline void nlr_pop(void){
+}
+
+#endif /* TEST_HOST_PY_RUNTIME_H */
@@ -0,0 +1,398 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/host/runtime.c
+ * @brief  host implementation of the micropython API used by the module
+ *
+ * This is just enough of micropython to drive the module from a C test
+ * program, exceptions are a longjmp to the last host_try.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "extmod/modmachine.h"
+
+#include "host.h"
+
+jmp_buf host_exception;
+const char* host_exception_text;
+mp_map_t host_no_kw;
+
+const mp_obj_base_t mp_const_none_obj;
+const mp_obj_base_t mp_const_false_obj;
+const mp_obj_base_t mp_const_true_obj;
+
+const mp_obj_type_t mp_type_module;
+const mp_obj_type_t mp_type_str;
+const mp_obj_type_t mp_type_float;
+const mp_obj_type_t mp_type_list;
+const mp_obj_type_t mp_type_tuple;
+const mp_obj_type_t mp_type_dict;
+const mp_obj_type_t mp_type_AttributeError;
+const mp_obj_type_t mp_type_NotImplementedError;
+const mp_obj_type_t mp_type_TypeError;
+const mp_obj_type_t mp_type_ValueError;
+
+typedef struct _host_str_t{
+    mp_obj_base_t base;
+    size_t len;
+    char* data;
+}host_str_t;
+
+typedef struct _host_float_t{
+    mp_obj_base_t base;
+    mp_float_t value;
+}host_float_t;
+
+typedef struct _host_tuple_t{
+    mp_obj_base_t base;
+    size_t len;
+    mp_obj_t* items;
+}host_tuple_t;
+
+
+/**
+ * memory, everything is zeroed like the micropython gc does
+ */
+void* m_malloc_maybe(size_t num_bytes){
+    return calloc(1, num_bytes ? num_bytes : 1);
+}
+
+void* m_malloc(size_t num_bytes){
+    void* ptr = m_malloc_maybe(num_bytes);
+    if(!ptr)
+        m_malloc_fail(num_bytes);
+    return ptr;
+}
+
+void* m_malloc0(size_t num_bytes){
+    return m_malloc(num_bytes);
+}
+
+void* m_realloc_maybe(void* ptr, size_t new_num_bytes, bool allow_move){
+    (void)allow_move;
+    return realloc(ptr, new_num_bytes ? new_num_bytes : 1);
+}
+
+void* m_realloc(void* ptr, size_t new_num_bytes){
+    void* new_ptr = m_realloc_maybe(ptr, new_num_bytes, true);
+    if(!new_ptr)
+        m_malloc_fail(new_num_bytes);
+    return new_ptr;
+}
+
+void m_free(void* ptr){
+    free(ptr);
+}
+
+
+/**
+ * exceptions
+ */
+void mp_raise_msg(const mp_obj_type_t* exc_type, mp_rom_error_text_t msg){
+    (void)exc_type;
+    host_exception_text = msg;
+    longjmp(host_exception, 1);
+}
+
+void mp_raise_ValueError(mp_rom_error_text_t msg){
+    mp_raise_msg(&mp_type_ValueError, msg);
+}
+
+void mp_raise_TypeError(mp_rom_error_text_t msg){
+    mp_raise_msg(&mp_type_TypeError, msg);
+}
+
+void m_malloc_fail(size_t num_bytes){
+    (void)num_bytes;
+    mp_raise_msg(NULL, "memory allocation failed");
+}
+
+
+/**
+ * qstr's, the ones of the module first, then the interned strings
+ */
+static const char* const qstr_names[] = {
+    "",
+#define QDEF(id) #id,
+#include "qstrdefs.h"
+#undef QDEF
+};
+
+static char** qstr_interned;
+static size_t qstr_interned_len;
+
+qstr qstr_find_strn(const char* str, size_t len){
+    for(size_t i = 1; i < MP_QSTRnumber_of; i++)
+        if((strlen(qstr_names[i]) == len) && !memcmp(qstr_names[i], str, len))
+            return i;
+    for(size_t i = 0; i < qstr_interned_len; i++)
+        if((strlen(qstr_interned[i]) == len) && !memcmp(qstr_interned[i], str, len))
+            return MP_QSTRnumber_of + i;
+    return MP_QSTRnull;
+}
+
+qstr qstr_from_strn(const char* str, size_t len){
+    qstr q = qstr_find_strn(str, len);
+    if(q != MP_QSTRnull)
+        return q;
+
+    qstr_interned = realloc(qstr_interned, sizeof(char*) * (qstr_interned_len + 1));
+    qstr_interned[qstr_interned_len] = strndup(str, len);
+    return MP_QSTRnumber_of + qstr_interned_len++;
+}
+
+const char* qstr_str(qstr q){
+    if(q < MP_QSTRnumber_of)
+        return qstr_names[q];
+    return qstr_interned[q - MP_QSTRnumber_of];
+}
+
+
+/**
+ * objects
+ */
+mp_obj_t host_str(const char* str){
+    return mp_obj_new_str(str, strlen(str));
+}
+
+mp_obj_t host_float(mp_float_t value){
+    return mp_obj_new_float(value);
+}
+
+mp_obj_t mp_obj_new_bool(mp_int_t value){
+    return value ? mp_const_true : mp_const_false;
+}
+
+mp_obj_t mp_obj_new_int(mp_int_t value){
+    return MP_OBJ_NEW_SMALL_INT(value);
+}
+
+mp_obj_t mp_obj_new_int_from_ull(unsigned long long value){
+    return MP_OBJ_NEW_SMALL_INT(value);
+}
+
+mp_obj_t mp_obj_new_float(mp_float_t value){
+    host_float_t* o = mp_obj_malloc(host_float_t, &mp_type_float);
+    o->value = value;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+mp_obj_t mp_obj_new_str(const char* data, size_t len){
+    host_str_t* o = mp_obj_malloc(host_str_t, &mp_type_str);
+    o->len  = len;
+    o->data = m_malloc(len + 1);
+    memcpy(o->data, data, len);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+mp_obj_t mp_obj_new_tuple(size_t n, const mp_obj_t* items){
+    host_tuple_t* o = mp_obj_malloc(host_tuple_t, &mp_type_tuple);
+    o->len   = n;
+    o->items = m_new(mp_obj_t, n);
+    memcpy(o->items, items, sizeof(mp_obj_t) * n);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+bool mp_obj_is_true(mp_obj_t arg){
+    if((arg == mp_const_false) || (arg == mp_const_none))
+        return false;
+    if(mp_obj_is_small_int(arg))
+        return MP_OBJ_SMALL_INT_VALUE(arg) != 0;
+    return true;
+}
+
+bool mp_obj_get_int_maybe(mp_const_obj_t arg, mp_int_t* value){
+    if(arg == mp_const_false)
+        *value = 0;
+    else if(arg == mp_const_true)
+        *value = 1;
+    else if(mp_obj_is_small_int(arg))
+        *value = MP_OBJ_SMALL_INT_VALUE(arg);
+    else
+        return false;
+    return true;
+}
+
+mp_int_t mp_obj_get_int(mp_const_obj_t arg){
+    mp_int_t value;
+    if(!mp_obj_get_int_maybe(arg, &value))
+        mp_raise_TypeError("can't convert to int");
+    return value;
+}
+
+bool mp_obj_get_float_maybe(mp_obj_t arg, mp_float_t* value){
+    mp_int_t i;
+    if(mp_obj_get_int_maybe(arg, &i))
+        *value = (mp_float_t)i;
+    else if(mp_obj_is_float(arg))
+        *value = ((host_float_t*)MP_OBJ_TO_PTR(arg))->value;
+    else
+        return false;
+    return true;
+}
+
+mp_float_t mp_obj_get_float(mp_obj_t self_in){
+    mp_float_t value;
+    if(!mp_obj_get_float_maybe(self_in, &value))
+        mp_raise_TypeError("can't convert to float");
+    return value;
+}
+
+void mp_obj_get_array(mp_obj_t o, size_t* len, mp_obj_t** items){
+    if(!mp_obj_is_type(o, &mp_type_tuple) && !mp_obj_is_type(o, &mp_type_list))
+        mp_raise_TypeError("object not iterable");
+    host_tuple_t* t = MP_OBJ_TO_PTR(o);
+    *len   = t->len;
+    *items = t->items;
+}
+
+void mp_obj_get_array_fixed_n(mp_obj_t o, size_t len, mp_obj_t** items){
+    size_t n;
+    mp_obj_get_array(o, &n, items);
+    if(n != len)
+        mp_raise_ValueError("wrong length");
+}
+
+const char* mp_obj_str_get_data(mp_obj_t self_in, size_t* len){
+    if(mp_obj_is_qstr(self_in)){
+        const char* str = qstr_str(MP_OBJ_QSTR_VALUE(self_in));
+        *len = strlen(str);
+        return str;
+    }
+    if(!mp_obj_is_type(self_in, &mp_type_str))
+        mp_raise_TypeError("can't convert to str");
+    host_str_t* s = MP_OBJ_TO_PTR(self_in);
+    *len = s->len;
+    return s->data;
+}
+
+const char* mp_obj_str_get_str(mp_obj_t self_in){
+    size_t len;
+    return mp_obj_str_get_data(self_in, &len);
+}
+
+qstr mp_obj_str_get_qstr(mp_obj_t self_in){
+    if(mp_obj_is_qstr(self_in))
+        return MP_OBJ_QSTR_VALUE(self_in);
+    size_t len;
+    const char* str = mp_obj_str_get_data(self_in, &len);
+    return qstr_from_strn(str, len);
+}
+
+bool mp_get_buffer(mp_obj_t obj, mp_buffer_info_t* bufinfo, mp_uint_t flags){
+    (void)flags;
+    if(!mp_obj_is_type(obj, &mp_type_str))
+        return false;
+    host_str_t* s = MP_OBJ_TO_PTR(obj);
+    bufinfo->buf      = s->data;
+    bufinfo->len      = s->len;
+    bufinfo->typecode = 'B';
+    return true;
+}
+
+void mp_get_buffer_raise(mp_obj_t obj, mp_buffer_info_t* bufinfo, mp_uint_t flags){
+    if(!mp_get_buffer(obj, bufinfo, flags))
+        mp_raise_TypeError("object with buffer protocol required");
+}
+
+mp_map_elem_t* mp_map_lookup(mp_map_t* map, mp_obj_t index, mp_map_lookup_kind_t lookup_kind){
+    (void)lookup_kind;
+    qstr q = mp_obj_str_get_qstr(index);
+    for(size_t i = 0; i < map->alloc; i++)
+        if(mp_map_slot_is_filled(map, i) && (mp_obj_str_get_qstr(map->table[i].key) == q))
+            return &map->table[i];
+    return NULL;
+}
+
+int mp_printf(const mp_print_t* print, const char* fmt, ...){
+    (void)print;
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vprintf(fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+
+/**
+ * arguments
+ */
+void mp_arg_check_num(size_t n_args, size_t n_kw, size_t n_args_min, size_t n_args_max, bool takes_kw){
+    if(n_kw && !takes_kw)
+        mp_raise_TypeError("function doesn't take keyword arguments");
+    if((n_args < n_args_min) || (n_args > n_args_max))
+        mp_raise_TypeError("wrong number of arguments");
+}
+
+void mp_arg_parse_all(size_t n_pos, const mp_obj_t* pos, mp_map_t* kws, size_t n_allowed,
+                      const mp_arg_t* allowed, mp_arg_val_t* out_vals){
+    size_t used_kw = 0;
+    for(size_t i = 0; i < n_allowed; i++){
+        mp_obj_t given = MP_OBJ_NULL;
+        if(i < n_pos){
+            if(allowed[i].flags & MP_ARG_KW_ONLY)
+                mp_raise_TypeError("extra positional arguments given");
+            given = pos[i];
+        }else if(kws){
+            mp_map_elem_t* kw = mp_map_lookup(kws, MP_OBJ_NEW_QSTR(allowed[i].qst), MP_MAP_LOOKUP);
+            if(kw){
+                given = kw->value;
+                used_kw++;
+            }
+        }
+
+        if(given == MP_OBJ_NULL){
+            if(allowed[i].flags & MP_ARG_REQUIRED)
+                mp_raise_TypeError("missing required argument");
+            out_vals[i] = allowed[i].defval;
+        }else if((allowed[i].flags & MP_ARG_KIND_MASK) == MP_ARG_BOOL){
+            out_vals[i].u_bool = mp_obj_is_true(given);
+        }else if((allowed[i].flags & MP_ARG_KIND_MASK) == MP_ARG_INT){
+            out_vals[i].u_int = mp_obj_get_int(given);
+        }else{
+            out_vals[i].u_obj = given;
+        }
+    }
+
+    if(n_pos > n_allowed)
+        mp_raise_TypeError("extra positional arguments given");
+    if(kws && (used_kw < kws->used))
+        mp_raise_TypeError("unexpected keyword argument");
+}
+
+
+/**
+ * hardware, the pins and the SPI bus go nowhere
+ */
+static int host_pins[8];
+
+mp_hal_pin_obj_t mp_hal_get_pin_obj(mp_obj_t pin_in){
+    return &host_pins[mp_obj_get_int(pin_in) % MP_ARRAY_SIZE(host_pins)];
+}
+
+static void host_spi_transfer(mp_obj_base_t* obj, size_t len, const uint8_t* src, uint8_t* dest){
+    (void)obj;
+    (void)len;
+    (void)src;
+    (void)dest;
+}
+
+static const mp_machine_spi_p_t host_spi_p = {
+    .transfer = host_spi_transfer,
+};
+
+static const mp_obj_type_t host_spi_type = {
+    .protocol = &host_spi_p,
+};
+
+static mp_obj_base_t host_spi = {
+    .type = &host_spi_type,
+};
+
+mp_obj_base_t* mp_hal_get_spi_obj(mp_obj_t spi_in){
+    (void)spi_in;
+    return &host_spi;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file   tlc5947-rgb-micropython/test/optimizer.c
+ * @brief  differential test of the pattern optimizer
+ *
+ * Runs a fixed set of random patterns and prints the color, visibility
+ * and brightness of the pattern after every tick. The Makefile builds
+ * this with TLC5947_OPTIMIZE=1 and 0, both outputs must be the same.
+ */
+#include "tlc5947.c"
+
+#include <stdio.h>
+
+#include "host.h"
+
+#define PATTERNS 4000 // number of random patterns
+#define TICKS    80   // ticks every pattern is run
+
+static uint32_t seed = 1;
+
+// the generator has to be the same on every host, so no rand()
+static uint32_t random_below(uint32_t n){
+    seed = seed * 1103515245U + 12345U;
+    return (seed >> 16) % n;
+}
+
+static char* generate(char* p, int depth){
+    int n = 1 + random_below(8);
+    for(int i = 0; i < n; i++){
+        switch(random_below(20)){
+        case 0:
+        case 1:  p += sprintf(p, "#%06X", (unsigned)random_below(0x1000000)); break;
+        case 2:  p += sprintf(p, "#%09X", (unsigned)random_below(0x1000000) * 64U); break;
+        case 3:  p += sprintf(p, "$%u,0.%u,0.%u", (unsigned)random_below(360),
+                              (unsigned)random_below(10), (unsigned)random_below(10)); break;
+        case 4:
+        case 5:  p += sprintf(p, "|%u", (unsigned)random_below(4)); break;
+        case 6:  p += sprintf(p, "|%ums", (unsigned)random_below(40)); break;
+        case 7:
+        case 8:  p += sprintf(p, "\b%s0.%u", random_below(2) ? "-" : "", (unsigned)random_below(10)); break;
+        case 9:  p += sprintf(p, "@"); break;
+        case 10: p += sprintf(p, "~%u", (unsigned)random_below(90)); break;
+        case 11: p += sprintf(p, "K%s%u", random_below(2) ? "+" : "", (unsigned)random_below(9000)); break;
+        case 12: p += sprintf(p, "^s%u", (unsigned)random_below(4)); break;
+        case 13:
+        case 14:
+            if(depth < 3){
+                p += sprintf(p, "<%u[", 1 + (unsigned)random_below(3));
+                p = generate(p, depth + 1);
+                p += sprintf(p, "-]>");
+            }
+            break;
+        case 15:
+        case 16:
+            if(depth < 4){
+                p += sprintf(p, "*%u(", (unsigned)random_below(5));
+                p = generate(p, depth + 1);
+                p += sprintf(p, ")");
+            }
+            break;
+        case 17:
+        case 18:
+            // loops forever if the stack top is not 0, every jump is a tick
+            if(depth < 4){
+                p += sprintf(p, "[");
+                p = generate(p, depth + 1);
+                p += sprintf(p, "]");
+            }
+            break;
+        case 19: p += sprintf(p, "<%u+->", (unsigned)random_below(3)); break;
+        }
+    }
+    return p;
+}
+
+int main(void){
+    mp_obj_t args[3] = {MP_OBJ_NEW_SMALL_INT(0), MP_OBJ_NEW_SMALL_INT(1), MP_OBJ_NEW_SMALL_INT(2)};
+    tlc5947_tlc5947_obj_t* self = MP_OBJ_TO_PTR(tlc5947_tlc5947_make_new(&tlc5947_tlc5947_type, 3, 0, args));
+
+    static const char* const subroutines[][2] = {
+        {"s0", "#FF0000|2"},
+        {"s1", "*2(|1)<2[|1-]>"},
+        {"s2", "^s0^s1\b0.5"},
+        {"s3", "@*3(\b-0.1)@"},
+    };
+    for(size_t i = 0; i < MP_ARRAY_SIZE(subroutines); i++)
+        tlc5947_tlc5947_define(self, host_str(subroutines[i][0]), host_str(subroutines[i][1]));
+
+    for(int n = 0; n < PATTERNS; n++){
+        static char pattern[8192];
+        char* end = generate(pattern, 0);
+        if(random_below(2))
+            *end++ = ';';
+        *end = '\0';
+
+        printf("%d: %s\n", n, pattern);
+
+        host_try{
+            mp_obj_t set_args[3] = {self, MP_OBJ_NEW_SMALL_INT(0), host_str(pattern)};
+            uint16_t pid = mp_obj_get_int(tlc5947_tlc5947_set(3, set_args, &host_no_kw));
+
+            for(int tick = 0; tick < TICKS; tick++){
+                tlc5947_tlc5947_call(self, 0, 0, NULL);
+                pattern_base_t* p = find_pattern(self, pid);
+                if(!p){
+                    printf(" done");
+                    break;
+                }
+                printf(" %04x%04x%04x,%d,%ld", p->color.r, p->color.g, p->color.b,
+                       p->visible, (long)p->brightness);
+            }
+            printf("\n");
+
+            tlc5947_tlc5947_delete(self, MP_OBJ_NEW_SMALL_INT(pid));
+        }else{
+            printf(" %s\n", host_exception_text);
+        }
+    }
+    return 0;
+}
@@ -36,9 +36,6 @@
 #include <string.h>
 #include "color.h"
 
-#define RGB12_MAGIC1 (16.0588235F) /* ((2^12)-1) / ((2^8)-1) */
-#define RGB12_MAGIC2 (16.0588236F) /*  */
-
 /**
  * these functions should be provided by libc <ctype.h>
  * but :
@@ -50,11 +47,17 @@ static int islower(int c){return ((c>='a')&&(c<='z'));}
 static int toupper(int c){return islower(c)?(c-32):c;}
 static char get_hex(uint8_t i){return "0123456789ABCDEF"[i];}
 
+static uint8_t get_nibble(char c){
+    c = toupper(c);
+    return c < 58 ? c - 48 : c - 55;
+}
+
 static uint8_t get_byte(const char* s){
-    uint8_t i;
-    i  = ((toupper(*s)) < 58 ? (*s++) - 48 : (*s++) - 55) << 4;
-    i |= ((toupper(*s)) < 58 ? (*s  ) - 48 : (*s  ) - 55);
-    return i;
+    return (get_nibble(s[0]) << 4) | get_nibble(s[1]);
+}
+
+static uint16_t get_12bit(const char* s){
+    return (get_nibble(s[0]) << 8) | (get_nibble(s[1]) << 4) | get_nibble(s[2]);
 }
 
 static void put_byte(char* s, uint8_t b){
@@ -66,6 +69,14 @@ rgb12 get_rgb12(const char* s){
     return rgb8torgb12(get_rgb8(s));
 }
 
+rgb12 get_rgb12_12bit(const char* s){
+    rgb12 c;
+    c.r = get_12bit(&s[1]);
+    c.g = get_12bit(&s[4]);
+    c.b = get_12bit(&s[7]);
+    return c;
+}
+
 
 rgb8 get_rgb8(const char* s){
     rgb8 c;
@@ -84,75 +95,369 @@ const char* put_rgb8(char* s, rgb8 c){
     return s + 7;
 }
 
+// v * 255 / 4095, rounded
+static uint8_t to_8bit(uint16_t v){
+    return (v * 255u + 2047) / 4095;
+}
+
 rgb8 rgb12torgb8(rgb12 c){
     rgb8 _c;
-    _c.r = (uint8_t)(c.r / RGB12_MAGIC1);
-    _c.g = (uint8_t)(c.g / RGB12_MAGIC1);
-    _c.b = (uint8_t)(c.b / RGB12_MAGIC1);
+    _c.r = to_8bit(c.r);
+    _c.g = to_8bit(c.g);
+    _c.b = to_8bit(c.b);
     return _c;
 }
 
+// replicates the upper bits, 0x00 -> 0x000, 0x80 -> 0x808, 0xFF -> 0xFFF
+static uint16_t to_12bit(uint8_t v){
+    return (v << 4) | (v >> 4);
+}
 
 rgb12 rgb8torgb12(rgb8 c){
     rgb12 _c;
-    _c.r = (uint16_t)(c.r * RGB12_MAGIC2);
-    _c.g = (uint16_t)(c.g * RGB12_MAGIC2);
-    _c.b = (uint16_t)(c.b * RGB12_MAGIC2);
+    _c.r = to_12bit(c.r);
+    _c.g = to_12bit(c.g);
+    _c.b = to_12bit(c.b);
     return _c;
 }
 
-static const uint16_t logLUT[2][12] = { {
-        0,  353, 1109, 1990, 2614, 3495, 4120, 5000, 5775, 6990, 8495, 10000},
-      { 0, 1500, 4000, 6000, 7000, 8000, 8500, 9000, 9300, 9600, 9800, 10000 }
-};
+rgb16 rgb12torgb16(rgb12 c){
+    rgb16 _c;
+    _c.r = c.r << 4;
+    _c.g = c.g << 4;
+    _c.b = c.b << 4;
+    return _c;
+}
 
-static float log_brightness(float f_linval){
-    uint16_t ipf;
-    uint16_t linval = (uint16_t)(f_linval * ((float)10000));
-
-    if(linval >= logLUT[1][11]){
-        ipf = logLUT[0][11];
-    }else{
-        int i;
-        for(i = 0; i < 11; i++){
-            if(linval < logLUT[1][i]){
-                break;
-            }
-        }
-
-        ipf = (linval - logLUT[1][i - 1]) * 10 / (logLUT[1][i] - logLUT[1][i - 1]);
-        ipf = logLUT[0][i - 1] + (logLUT[0][i] - logLUT[0][i - 1]) * ipf / 10;
-    }
+static uint16_t round_12_4(uint16_t v){
+    v = (v >> 4) + ((v >> 3) & 1);
+    return v > 4095 ? 4095 : v;
+}
 
-    return (float)(((float)ipf) / ((float)10000));
+rgb12 rgb16torgb12(rgb16 c){
+    rgb12 _c;
+    _c.r = round_12_4(c.r);
+    _c.g = round_12_4(c.g);
+    _c.b = round_12_4(c.b);
+    return _c;
 }
 
+// v * x / 4095, rounded
+static uint16_t scale_12bit(uint32_t v, uint32_t x){
+    return (v * x + 2047) / 4095;
+}
+
+rgb12 hsvtorgb12(hsv c){
+    uint32_t sector = c.h >> 12;
+    uint32_t f      = c.h & 0xFFF;
+
+    uint16_t v = c.v;
+    uint16_t p = scale_12bit(c.v, 4095 - c.s);
+    uint16_t q = scale_12bit(c.v, 4095 - ((c.s * f) >> 12));
+    uint16_t t = scale_12bit(c.v, 4095 - ((c.s * (4096 - f)) >> 12));
 
-rgb12 rgb12_brightness(rgb12 c, float brightness){
     rgb12 _c;
+    switch(sector){
+    case 0:  _c.r = v; _c.g = t; _c.b = p; break;
+    case 1:  _c.r = q; _c.g = v; _c.b = p; break;
+    case 2:  _c.r = p; _c.g = v; _c.b = t; break;
+    case 3:  _c.r = p; _c.g = q; _c.b = v; break;
+    case 4:  _c.r = t; _c.g = p; _c.b = v; break;
+    default: _c.r = v; _c.g = p; _c.b = q; break;
+    }
+    return _c;
+}
 
-    float b = log_brightness(brightness);
+hsv rgb12tohsv(rgb12 c){
+    int32_t r = c.r, g = c.g, b = c.b;
+    int32_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    int32_t min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+    int32_t delta = max - min;
 
-    _c.r = (uint16_t)((float)c.r * b);
-    _c.g = (uint16_t)((float)c.g * b);
-    _c.b = (uint16_t)((float)c.b * b);
+    hsv _c = {.h = 0, .s = 0, .v = max};
+    if(!delta)
+        return _c; // gray, the hue is undefined
 
+    _c.s = (delta * 4095 + (max / 2)) / max;
+
+    int32_t h;
+    if(max == r)
+        h = (0 * 4096) + ((g - b) * 4096) / delta;
+    else if(max == g)
+        h = (2 * 4096) + ((b - r) * 4096) / delta;
+    else
+        h = (4 * 4096) + ((r - g) * 4096) / delta;
+
+    if(h < 0)
+        h += HSV_HUE_MAX;
+    _c.h = h;
     return _c;
 }
 
-void default_white_balance(white_balance_matrix m){
-    for(uint8_t i = 0; i < 3; i++)
-        m[i] = 1.0F;
+/**
+ * blackbody colors from KELVIN_MIN to KELVIN_MAX in steps of KELVIN_STEP,
+ * generated with Tanner Helland's approximation and scaled to 12bit
+ */
+#define KELVIN_STEP 200
+static const rgb12 kelvin_table[((KELVIN_MAX - KELVIN_MIN) / KELVIN_STEP) + 1] = {
+    {4095, 1091,    0}, {4095, 1382,    0}, {4095, 1628,    0}, {4095, 1841,    0},
+    {4095, 2030,    0}, {4095, 2198,  223}, {4095, 2350,  629}, {4095, 2489,  972},
+    {4095, 2617, 1269}, {4095, 2735, 1531}, {4095, 2846, 1765}, {4095, 2949, 1977},
+    {4095, 3046, 2171}, {4095, 3137, 2349}, {4095, 3223, 2514}, {4095, 3305, 2667},
+    {4095, 3383, 2811}, {4095, 3457, 2945}, {4095, 3528, 3073}, {4095, 3596, 3193},
+    {4095, 3662, 3307}, {4095, 3724, 3416}, {4095, 3785, 3519}, {4095, 3843, 3618},
+    {4095, 3899, 3713}, {4095, 3953, 3803}, {4095, 4005, 3891}, {4095, 4056, 3975},
+    {4095, 4095, 4095}, {4014, 3955, 4095}, {3896, 3888, 4095}, {3803, 3835, 4095},
+    {3725, 3791, 4095}, {3660, 3753, 4095}, {3603, 3720, 4095}, {3552, 3690, 4095},
+    {3508, 3664, 4095}, {3467, 3640, 4095}, {3430, 3618, 4095}, {3397, 3598, 4095},
+    {3366, 3579, 4095}, {3337, 3561, 4095}, {3310, 3545, 4095}, {3285, 3530, 4095},
+    {3261, 3516, 4095}, {3239, 3502, 4095}, {3218, 3489, 4095}, {3198, 3477, 4095},
+    {3179, 3465, 4095}, {3161, 3454, 4095}, {3144, 3443, 4095}, {3128, 3433, 4095},
+    {3112, 3423, 4095}, {3097, 3414, 4095}, {3083, 3405, 4095}, {3069, 3396, 4095},
+    {3055, 3388, 4095}, {3043, 3380, 4095}, {3030, 3372, 4095}, {3018, 3364, 4095},
+    {3006, 3357, 4095}, {2995, 3350, 4095}, {2984, 3343, 4095}, {2974, 3336, 4095},
+    {2963, 3330, 4095}, {2953, 3323, 4095}, {2944, 3317, 4095}, {2934, 3311, 4095},
+    {2925, 3305, 4095}, {2916, 3300, 4095}, {2907, 3294, 4095}, {2899, 3288, 4095},
+    {2891, 3283, 4095}, {2883, 3278, 4095}, {2875, 3273, 4095}, {2867, 3268, 4095},
+    {2859, 3263, 4095}, {2852, 3258, 4095}, {2845, 3253, 4095}, {2838, 3249, 4095},
+    {2831, 3244, 4095}, {2824, 3240, 4095}, {2817, 3236, 4095}, {2811, 3231, 4095},
+    {2804, 3227, 4095}, {2798, 3223, 4095}, {2792, 3219, 4095}, {2786, 3215, 4095},
+    {2780, 3211, 4095}, {2774, 3207, 4095}, {2768, 3204, 4095}, {2763, 3200, 4095},
+    {2757, 3196, 4095}, {2752, 3193, 4095}, {2747, 3189, 4095}, {2741, 3186, 4095}
+};
+
+static uint16_t lerp_12bit(uint16_t a, uint16_t b, uint32_t f){
+    return (uint16_t)((int32_t)a + ((((int32_t)b - (int32_t)a) * (int32_t)f) / KELVIN_STEP));
 }
 
-rgb12 rgb12_white_balance(rgb12 c, const white_balance_matrix m){
+rgb12 kelvintorgb12(uint32_t kelvin){
+    if(kelvin < KELVIN_MIN)
+        kelvin = KELVIN_MIN;
+    if(kelvin >= KELVIN_MAX)
+        return kelvin_table[(KELVIN_MAX - KELVIN_MIN) / KELVIN_STEP];
+
+    uint32_t i = (kelvin - KELVIN_MIN) / KELVIN_STEP;
+    uint32_t f = (kelvin - KELVIN_MIN) % KELVIN_STEP;
+
+    // linear interpolation between the two closest entries
+    rgb12 a = kelvin_table[i];
+    rgb12 b = kelvin_table[i + 1];
     rgb12 _c;
-    _c.r = (uint16_t)(c.r * m[0]);
-    _c.g = (uint16_t)(c.g * m[1]);
-    _c.b = (uint16_t)(c.b * m[2]);
+    _c.r = lerp_12bit(a.r, b.r, f);
+    _c.g = lerp_12bit(a.g, b.g, f);
+    _c.b = lerp_12bit(a.b, b.b, f);
+    return _c;
+}
+
+static uint16_t blend_channel(uint16_t dst, uint16_t src, int mode, uint16_t alpha){
+    uint32_t b;
+    switch(mode){
+    case BLEND_ADD:
+        b = dst + src;
+        if(b > 65520)
+            b = 65520;
+        break;
+    case BLEND_MULTIPLY:
+        b = ((uint32_t)dst * src) / 65520;
+        break;
+    case BLEND_MAX:
+        b = dst > src ? dst : src;
+        break;
+    default:
+        b = src;
+        break;
+    }
+    return dst + ((((int32_t)b - (int32_t)dst) * alpha) / 4096);
+}
+
+rgb16 rgb16_blend(rgb16 dst, rgb16 src, int mode, uint16_t alpha){
+    rgb16 _c;
+    _c.r = blend_channel(dst.r, src.r, mode, alpha);
+    _c.g = blend_channel(dst.g, src.g, mode, alpha);
+    _c.b = blend_channel(dst.b, src.b, mode, alpha);
     return _c;
 }
 
+bool rgb12_equal(rgb12 a, rgb12 b){
+    return (a.r == b.r) && (a.g == b.g) && (a.b == b.b);
+}
+
+bool rgb16_equal(rgb16 a, rgb16 b){
+    return (a.r == b.r) && (a.g == b.g) && (a.b == b.b);
+}
+
+/**
+ * brightness curves, 257 entries from brightness 0 -> 1
+ * the values are Q15 (32768 == 1.0)
+ *
+ * log:     the 12 point curve used before the curves were selectable
+ * cie1931: CIE 1931 lightness L*
+ */
+static const uint16_t curve_log[CURVE_SIZE] = {
+        0,    30,    60,    90,   120,   151,   181,   211,   241,   271,   301,   331,
+      361,   392,   422,   452,   482,   512,   542,   572,   602,   633,   663,   693,
+      723,   753,   783,   813,   843,   874,   904,   934,   964,   994,  1024,  1054,
+     1084,  1115,  1145,  1180,  1219,  1257,  1296,  1335,  1373,  1412,  1451,  1490,
+     1528,  1567,  1606,  1644,  1683,  1722,  1761,  1799,  1838,  1877,  1915,  1954,
+     1993,  2031,  2070,  2109,  2148,  2186,  2225,  2264,  2302,  2341,  2380,  2419,
+     2457,  2496,  2535,  2573,  2612,  2651,  2690,  2728,  2767,  2806,  2844,  2883,
+     2922,  2960,  2999,  3038,  3077,  3115,  3154,  3193,  3231,  3270,  3309,  3348,
+     3386,  3425,  3464,  3502,  3541,  3580,  3618,  3668,  3724,  3781,  3837,  3893,
+     3950,  4006,  4062,  4119,  4175,  4232,  4288,  4344,  4401,  4457,  4514,  4570,
+     4626,  4683,  4739,  4795,  4852,  4908,  4965,  5021,  5077,  5134,  5190,  5247,
+     5303,  5359,  5416,  5472,  5528,  5585,  5641,  5698,  5754,  5810,  5867,  5923,
+     5980,  6036,  6092,  6149,  6205,  6261,  6318,  6374,  6431,  6487,  6553,  6633,
+     6713,  6792,  6872,  6952,  7032,  7112,  7192,  7272,  7352,  7431,  7511,  7591,
+     7671,  7751,  7831,  7911,  7990,  8070,  8150,  8230,  8310,  8390,  8470,  8550,
+     8656,  8769,  8881,  8994,  9107,  9220,  9332,  9445,  9558,  9671,  9783,  9896,
+    10009, 10122, 10235, 10347, 10460, 10573, 10686, 10798, 10911, 11024, 11137, 11249,
+    11362, 11484, 11644, 11804, 11964, 12124, 12284, 12444, 12604, 12764, 12924, 13084,
+    13244, 13404, 13591, 13816, 14041, 14266, 14492, 14717, 14942, 15167, 15393, 15618,
+    15843, 16069, 16294, 16582, 16913, 17244, 17574, 17905, 18236, 18566, 18897, 19400,
+    19919, 20437, 20956, 21474, 21992, 22511, 23136, 24099, 25062, 26026, 26989, 27952,
+    28915, 29878, 30842, 31805, 32768
+};
+
+static const uint16_t curve_linear[CURVE_SIZE] = {
+        0,   128,   256,   384,   512,   640,   768,   896,  1024,  1152,  1280,  1408,
+     1536,  1664,  1792,  1920,  2048,  2176,  2304,  2432,  2560,  2688,  2816,  2944,
+     3072,  3200,  3328,  3456,  3584,  3712,  3840,  3968,  4096,  4224,  4352,  4480,
+     4608,  4736,  4864,  4992,  5120,  5248,  5376,  5504,  5632,  5760,  5888,  6016,
+     6144,  6272,  6400,  6528,  6656,  6784,  6912,  7040,  7168,  7296,  7424,  7552,
+     7680,  7808,  7936,  8064,  8192,  8320,  8448,  8576,  8704,  8832,  8960,  9088,
+     9216,  9344,  9472,  9600,  9728,  9856,  9984, 10112, 10240, 10368, 10496, 10624,
+    10752, 10880, 11008, 11136, 11264, 11392, 11520, 11648, 11776, 11904, 12032, 12160,
+    12288, 12416, 12544, 12672, 12800, 12928, 13056, 13184, 13312, 13440, 13568, 13696,
+    13824, 13952, 14080, 14208, 14336, 14464, 14592, 14720, 14848, 14976, 15104, 15232,
+    15360, 15488, 15616, 15744, 15872, 16000, 16128, 16256, 16384, 16512, 16640, 16768,
+    16896, 17024, 17152, 17280, 17408, 17536, 17664, 17792, 17920, 18048, 18176, 18304,
+    18432, 18560, 18688, 18816, 18944, 19072, 19200, 19328, 19456, 19584, 19712, 19840,
+    19968, 20096, 20224, 20352, 20480, 20608, 20736, 20864, 20992, 21120, 21248, 21376,
+    21504, 21632, 21760, 21888, 22016, 22144, 22272, 22400, 22528, 22656, 22784, 22912,
+    23040, 23168, 23296, 23424, 23552, 23680, 23808, 23936, 24064, 24192, 24320, 24448,
+    24576, 24704, 24832, 24960, 25088, 25216, 25344, 25472, 25600, 25728, 25856, 25984,
+    26112, 26240, 26368, 26496, 26624, 26752, 26880, 27008, 27136, 27264, 27392, 27520,
+    27648, 27776, 27904, 28032, 28160, 28288, 28416, 28544, 28672, 28800, 28928, 29056,
+    29184, 29312, 29440, 29568, 29696, 29824, 29952, 30080, 30208, 30336, 30464, 30592,
+    30720, 30848, 30976, 31104, 31232, 31360, 31488, 31616, 31744, 31872, 32000, 32128,
+    32256, 32384, 32512, 32640, 32768
+};
+
+static const uint16_t curve_cie1931[CURVE_SIZE] = {
+        0,    14,    28,    43,    57,    71,    85,    99,   113,   128,   142,   156,
+      170,   184,   198,   213,   227,   241,   255,   269,   283,   298,   312,   327,
+      343,   359,   376,   393,   410,   428,   447,   466,   486,   506,   527,   548,
+      570,   593,   616,   640,   664,   689,   714,   741,   767,   795,   823,   852,
+      881,   911,   942,   973,  1005,  1038,  1071,  1106,  1141,  1176,  1213,  1250,
+     1288,  1326,  1366,  1406,  1447,  1489,  1531,  1575,  1619,  1664,  1709,  1756,
+     1804,  1852,  1901,  1951,  2002,  2054,  2106,  2160,  2215,  2270,  2326,  2383,
+     2442,  2501,  2561,  2622,  2684,  2747,  2810,  2875,  2941,  3008,  3076,  3145,
+     3215,  3286,  3358,  3431,  3505,  3580,  3656,  3733,  3812,  3891,  3971,  4053,
+     4136,  4220,  4305,  4391,  4478,  4566,  4656,  4747,  4839,  4932,  5026,  5121,
+     5218,  5316,  5415,  5515,  5617,  5720,  5824,  5929,  6035,  6143,  6252,  6363,
+     6474,  6587,  6702,  6817,  6934,  7052,  7172,  7293,  7415,  7538,  7663,  7790,
+     7918,  8047,  8177,  8309,  8442,  8577,  8713,  8851,  8990,  9130,  9272,  9416,
+     9561,  9707,  9855, 10004, 10155, 10307, 10461, 10617, 10774, 10932, 11092, 11254,
+    11417, 11582, 11748, 11916, 12085, 12256, 12429, 12603, 12779, 12956, 13136, 13316,
+    13499, 13683, 13869, 14056, 14245, 14436, 14629, 14823, 15019, 15216, 15416, 15617,
+    15820, 16024, 16231, 16439, 16649, 16860, 17074, 17289, 17506, 17725, 17946, 18168,
+    18393, 18619, 18847, 19077, 19308, 19542, 19777, 20015, 20254, 20495, 20738, 20983,
+    21230, 21479, 21730, 21982, 22237, 22494, 22752, 23013, 23275, 23540, 23806, 24075,
+    24346, 24618, 24893, 25169, 25448, 25729, 26011, 26296, 26583, 26872, 27163, 27456,
+    27752, 28049, 28349, 28650, 28954, 29260, 29568, 29878, 30190, 30505, 30822, 31141,
+    31462, 31785, 32110, 32438, 32768
+};
+
+static const uint16_t curve_gamma22[CURVE_SIZE] = {
+        0,     0,     1,     2,     3,     6,     8,    12,    16,    21,    26,    32,
+       39,    47,    55,    64,    74,    84,    95,   107,   120,   134,   148,   163,
+      179,   196,   214,   232,   252,   272,   293,   315,   338,   361,   386,   411,
+      438,   465,   493,   522,   552,   583,   614,   647,   681,   715,   751,   787,
+      824,   862,   902,   942,   983,  1025,  1068,  1112,  1157,  1203,  1250,  1298,
+     1347,  1397,  1447,  1499,  1552,  1606,  1661,  1717,  1774,  1831,  1890,  1950,
+     2011,  2073,  2136,  2200,  2265,  2331,  2398,  2467,  2536,  2606,  2677,  2750,
+     2823,  2898,  2973,  3050,  3127,  3206,  3286,  3367,  3449,  3532,  3616,  3701,
+     3787,  3875,  3963,  4052,  4143,  4235,  4328,  4421,  4516,  4613,  4710,  4808,
+     4907,  5008,  5110,  5212,  5316,  5421,  5527,  5635,  5743,  5852,  5963,  6075,
+     6188,  6302,  6417,  6533,  6650,  6769,  6889,  7010,  7132,  7255,  7379,  7504,
+     7631,  7759,  7888,  8018,  8149,  8281,  8415,  8550,  8686,  8823,  8961,  9100,
+     9241,  9383,  9526,  9670,  9815,  9962, 10109, 10258, 10408, 10559, 10712, 10866,
+    11020, 11176, 11334, 11492, 11652, 11812, 11974, 12138, 12302, 12468, 12635, 12803,
+    12972, 13142, 13314, 13487, 13661, 13836, 14013, 14191, 14370, 14550, 14731, 14914,
+    15098, 15283, 15470, 15657, 15846, 16036, 16227, 16420, 16614, 16809, 17005, 17203,
+    17401, 17601, 17803, 18005, 18209, 18414, 18620, 18828, 19037, 19247, 19458, 19670,
+    19884, 20099, 20316, 20533, 20752, 20972, 21194, 21416, 21640, 21865, 22092, 22320,
+    22549, 22779, 23011, 23243, 23478, 23713, 23950, 24188, 24427, 24667, 24909, 25152,
+    25397, 25642, 25889, 26138, 26387, 26638, 26890, 27144, 27399, 27655, 27912, 28171,
+    28431, 28692, 28954, 29218, 29484, 29750, 30018, 30287, 30557, 30829, 31102, 31376,
+    31652, 31929, 32207, 32487, 32768
+};
+
+static const uint16_t curve_gamma28[CURVE_SIZE] = {
+        0,     0,     0,     0,     0,     1,     1,     1,     2,     3,     4,     5,
+        6,     8,    10,    12,    14,    17,    19,    23,    26,    30,    34,    38,
+       43,    49,    54,    60,    67,    74,    81,    89,    97,   106,   115,   125,
+      135,   146,   157,   169,   181,   194,   208,   222,   237,   252,   268,   285,
+      302,   320,   338,   358,   378,   398,   420,   442,   465,   488,   513,   538,
+      564,   591,   618,   646,   676,   706,   736,   768,   801,   834,   868,   903,
+      940,   977,  1014,  1053,  1093,  1134,  1176,  1218,  1262,  1307,  1352,  1399,
+     1447,  1495,  1545,  1596,  1648,  1701,  1755,  1810,  1866,  1924,  1982,  2042,
+     2103,  2164,  2227,  2292,  2357,  2424,  2491,  2560,  2631,  2702,  2775,  2849,
+     2924,  3000,  3078,  3157,  3237,  3319,  3402,  3486,  3572,  3658,  3747,  3836,
+     3927,  4020,  4113,  4208,  4305,  4403,  4502,  4603,  4705,  4809,  4914,  5020,
+     5128,  5238,  5349,  5462,  5576,  5691,  5808,  5927,  6047,  6169,  6292,  6417,
+     6543,  6671,  6801,  6932,  7065,  7199,  7336,  7473,  7613,  7754,  7897,  8041,
+     8187,  8335,  8484,  8636,  8788,  8943,  9100,  9258,  9418,  9579,  9743,  9908,
+    10075, 10244, 10414, 10587, 10761, 10937, 11115, 11295, 11477, 11660, 11846, 12033,
+    12222, 12413, 12606, 12801, 12998, 13197, 13397, 13600, 13804, 14011, 14220, 14430,
+    14643, 14857, 15074, 15292, 15513, 15736, 15960, 16187, 16416, 16647, 16880, 17115,
+    17352, 17591, 17832, 18076, 18321, 18569, 18819, 19071, 19325, 19581, 19840, 20100,
+    20363, 20628, 20896, 21165, 21437, 21711, 21987, 22265, 22546, 22829, 23114, 23402,
+    23692, 23984, 24278, 24575, 24874, 25175, 25479, 25785, 26093, 26404, 26717, 27033,
+    27351, 27671, 27994, 28319, 28646, 28976, 29309, 29644, 29981, 30320, 30663, 31007,
+    31354, 31704, 32056, 32411, 32768
+};
+
+const uint16_t* brightness_curve(int curve){
+    switch(curve){
+    case CURVE_LOG:     return curve_log;
+    case CURVE_LINEAR:  return curve_linear;
+    case CURVE_CIE1931: return curve_cie1931;
+    case CURVE_GAMMA22: return curve_gamma22;
+    case CURVE_GAMMA28: return curve_gamma28;
+    default:            return NULL;
+    }
+}
+
+static uint32_t curve_lookup(uint32_t brightness, const uint16_t* curve){
+    uint32_t i = brightness >> 8;
+    if(i >= (CURVE_SIZE - 1))
+        return curve[CURVE_SIZE - 1];
+
+    // linear interpolation between the two closest entries
+    int32_t a = curve[i];
+    int32_t b = curve[i + 1];
+    return a + (((b - a) * (int32_t)(brightness & 0xFF)) >> 8);
+}
+
+rgb16 rgb12_brightness(rgb12 c, uint32_t brightness, const uint16_t* curve){
+    rgb16 _c;
+
+    uint32_t b = curve_lookup(brightness, curve);
+
+    // 12bit * Q15 >> 11 == 12.4 fixed point
+    _c.r = (c.r * b + (1 << 10)) >> 11;
+    _c.g = (c.g * b + (1 << 10)) >> 11;
+    _c.b = (c.b * b + (1 << 10)) >> 11;
+
+    return _c;
+}
+
+void default_white_balance(white_balance_matrix m){
+    for(uint8_t i = 0; i < 3; i++)
+        m[i] = 1.0F;
+}
+
 
 #define ADD_F(a, b) ((float)(((float)a)+((float)b)))
 #define ADD3_F(a, b, c) ((float)(ADD_F(ADD_F(a, b), ((float)(c)))))
@@ -169,11 +474,26 @@ void default_gamut_matrix(gamut_matrix m){
         m[i][i] = 1.0F;
 }
 
-rgb12 rgb12_gamut(rgb12 c, gamut_matrix m){
-    rgb12 _c;
-    _c.r = (uint16_t)((c.r * m[0][0]) + (c.g * m[0][1]) + (c.b * m[0][2]));
-    _c.g = (uint16_t)((c.r * m[1][0]) + (c.g * m[1][1]) + (c.b * m[1][2]));
-    _c.b = (uint16_t)((c.r * m[2][0]) + (c.g * m[2][1]) + (c.b * m[2][2]));
+void color_matrix_set(color_matrix m, const white_balance_matrix w, gamut_matrix g){
+    for(uint8_t i = 0; i < 3; i++)
+        for(uint8_t j = 0; j < 3; j++)
+            m[i][j] = (int32_t)((g[i][j] * w[j] * 65536.0F) + 0.5F);
+}
+
+/**
+ * all elements are 0 -> 1 and every row sums up to <= 1,
+ * so the products of a row always fit into 32 bits unsigned
+ */
+static uint16_t q16_to_12_4(uint32_t v){
+    v = (v >> 16) + ((v >> 15) & 1);
+    return v > 65520 ? 65520 : v;
+}
+
+rgb16 rgb16_color_matrix(rgb16 c, const color_matrix m){
+    rgb16 _c;
+    _c.r = q16_to_12_4(((uint32_t)m[0][0] * c.r) + ((uint32_t)m[0][1] * c.g) + ((uint32_t)m[0][2] * c.b));
+    _c.g = q16_to_12_4(((uint32_t)m[1][0] * c.r) + ((uint32_t)m[1][1] * c.g) + ((uint32_t)m[1][2] * c.b));
+    _c.b = q16_to_12_4(((uint32_t)m[2][0] * c.r) + ((uint32_t)m[2][1] * c.g) + ((uint32_t)m[2][2] * c.b));
     return _c;
 }
 
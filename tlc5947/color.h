@@ -40,6 +40,27 @@ typedef struct{
     uint16_t b:12; /*< blue  [0 -> 4095] */
 }rgb12;
 
+/**
+ * 12.4 fixed point color, the upper 12 bits are the grayscale value
+ * the lower 4 bits the fractional part used for dithering
+ */
+typedef struct{
+    uint16_t r; /*< red   [0 -> 65520] */
+    uint16_t g; /*< green [0 -> 65520] */
+    uint16_t b; /*< blue  [0 -> 65520] */
+}rgb16;
+
+/**
+ * HSV color, the hue circle is split into 6 sectors
+ * of 4096 steps each (60 degrees per sector)
+ */
+#define HSV_HUE_MAX (6 * 4096)
+typedef struct{
+    uint16_t h; /*< hue        [0 -> HSV_HUE_MAX - 1] */
+    uint16_t s; /*< saturation [0 -> 4095] */
+    uint16_t v; /*< value      [0 -> 4095] */
+}hsv;
+
 typedef struct{
     uint8_t r; /*< red   [0 -> 255] */
     uint8_t g; /*< green [0 -> 255] */
@@ -49,6 +70,12 @@ typedef struct{
 typedef float white_balance_matrix[3];
 typedef float gamut_matrix[3][3];
 
+/**
+ * white balance and gamut combined into a single fixed point matrix,
+ * the elements are Q16 (65536 == 1.0)
+ */
+typedef int32_t color_matrix[3][3];
+
 #if defined(__cplusplus)
 extern "C"{
 #endif /* defined(__cplusplus) */
@@ -65,6 +92,12 @@ extern "C"{
 rgb12 get_rgb12(const char* s);
 rgb8 get_rgb8(const char* s);
 
+/**
+ * same as get_rgb12 but takes a 12bit color:
+ *     "#RRRGGGBBB"
+ */
+rgb12 get_rgb12_12bit(const char* s);
+
 /**
  * writes a string in the format to s:
  *     "#RRGGBB\0"
@@ -73,18 +106,89 @@ rgb8 get_rgb8(const char* s);
  */
 const char* put_rgb8(char* s, rgb8 c);
 
+/**
+ * exact integer conversions, 8bit colors are converted to 12bit by
+ * replicating the upper bits, the conversion back is rounded so
+ * rgb12torgb8(rgb8torgb12(c)) == c
+ */
 rgb8 rgb12torgb8(rgb12 c)__attribute__ ((const));
 
 rgb12 rgb8torgb12(rgb8 c)__attribute__ ((const));
 
-rgb12 rgb12_brightness(rgb12 c, float brightness);
+rgb16 rgb12torgb16(rgb12 c)__attribute__ ((const));
+
+/**
+ * rounds the 12.4 fixed point color to the nearest 12bit color
+ */
+rgb12 rgb16torgb12(rgb16 c)__attribute__ ((const));
+
+/**
+ * integer HSV conversions, no floating point is used
+ */
+rgb12 hsvtorgb12(hsv c)__attribute__ ((const));
+hsv rgb12tohsv(rgb12 c)__attribute__ ((const));
+
+/**
+ * color temperature to color, kelvin is clamped to
+ * KELVIN_MIN -> KELVIN_MAX
+ */
+#define KELVIN_MIN 1000
+#define KELVIN_MAX 20000
+rgb12 kelvintorgb12(uint32_t kelvin)__attribute__ ((const));
+
+/**
+ * blend modes, src is blended onto dst and the result is
+ * mixed with dst by alpha (0 -> 4096)
+ */
+enum{
+    BLEND_NORMAL,   // src, opaque
+    BLEND_ALPHA,    // src
+    BLEND_ADD,      // dst + src
+    BLEND_MULTIPLY, // dst * src
+    BLEND_MAX,      // max(dst, src)
+};
+rgb16 rgb16_blend(rgb16 dst, rgb16 src, int mode, uint16_t alpha)__attribute__ ((const));
+
+bool rgb12_equal(rgb12 a, rgb12 b)__attribute__ ((const));
+bool rgb16_equal(rgb16 a, rgb16 b)__attribute__ ((const));
+
+/**
+ * brightness curves, every curve is a table of CURVE_SIZE
+ * Q15 values, mapping brightness 0 -> 1 to the output
+ */
+#define CURVE_SIZE 257
+enum{
+    CURVE_LOG,
+    CURVE_LINEAR,
+    CURVE_CIE1931,
+    CURVE_GAMMA22,
+    CURVE_GAMMA28,
+};
+
+/**
+ * returns the table of a builtin curve or NULL
+ */
+const uint16_t* brightness_curve(int curve);
+
+/**
+ * scales c by brightness (Q16 0 -> 65536) through the curve,
+ * the fractional part of the result is kept in the 12.4
+ * fixed point color.
+ */
+rgb16 rgb12_brightness(rgb12 c, uint32_t brightness, const uint16_t* curve);
 
 void default_white_balance(white_balance_matrix m);
-rgb12 rgb12_white_balance(rgb12 c, const white_balance_matrix m);
 
 void default_gamut_matrix(gamut_matrix m);
 bool gamut_matrix_valid(gamut_matrix m);
-rgb12 rgb12_gamut(rgb12 c, gamut_matrix m);
+
+/**
+ * combines the white balance and the gamut matrix into m:
+ *     m = gamut * diag(white_balance)
+ * this is the same as applying the white balance and then the gamut.
+ */
+void color_matrix_set(color_matrix m, const white_balance_matrix w, gamut_matrix g);
+rgb16 rgb16_color_matrix(rgb16 c, const color_matrix m);
 
 #if defined(__cplusplus)
 }
@@ -34,6 +34,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "py/obj.h"
 #include "py/runtime.h"
@@ -41,12 +42,31 @@
 #include "extmod/modmachine.h"
 
 #include "color.h"
+#include "transfer.h"
+
+// number of calibration profiles, profile 0 is the global calibration
+#define TLC5947_PROFILES 8
+
+// default tick rate in Hz, see freq()
+#define TLC5947_FREQ 100
+#define TLC5947_FREQ_MHZ (TLC5947_FREQ * 1000U)
+
+// 0 compiles the patterns as written, test/ compares both builds
+#ifndef TLC5947_OPTIMIZE
+#define TLC5947_OPTIMIZE 1
+#endif
 
 /**
  * LED language
  *
  * "#RRGGBB"      this is a color in RGB format
+ * "#RRRGGGBBB"   this is a 12bit color in RGB format
+ * "$H,S,V"       this is a color in HSV format
+ * "~30"          this rotates the hue by 30 degrees
+ * "K2700"        this is a color temperature in kelvin
+ * "K+100"        this changes the color temperature by +100 kelvin
  * "|50"          this sleeps for 50 ticks
+ * "|250ms"       this sleeps for 250 milliseconds, see freq()
  * "\b25"         this decreases brightness by 25%
  * "<5"           this pushes 5 onto the stack
  * ">"            this pops a value from the stack
@@ -54,6 +74,9 @@
  * "-"            decrement current stack value
  * "]"            Jump to the matching marker if stack value is not 0
  * "["            Marker
+ * "*5( )"        repeat the tokens between the parentheses 5 times
+ * "^fade"        call the subroutine fade, see define()
+ * "|{t}"         a placeholder, the operand is set by set(..., t=50)
  * ";"            loop forever
  * "@"            toggle the transparency
  *
@@ -79,6 +102,8 @@
 typedef enum{
     pCOLOR,       // change color
     pTRANSPARENT, // toggle the transparency
+    pHUE,         // rotate the hue
+    pKELVIN,      // change color temperature
     pSLEEP,       // sleep for x amount of ticks
     pBRIGHTNESS,  // change overall brightness
     pINCREMENT,   // increment current stack value
@@ -87,7 +112,11 @@ typedef enum{
     pJUMP_NZERO,  // jump to the matching marker if stack value is not 0
     pMARK,        // Marker for jump
     pPUSH,        // Push value onto the stack
-    pPOP          // Pop value from the stack
+    pPOP,         // Pop value from the stack
+    pREPEAT,      // start a counted loop
+    pREPEAT_END,  // jump to the start of the counted loop until it is done
+    pCALL,        // call a subroutine
+    pRETURN       // return from a subroutine
 }token_type_t;
 
 /**
@@ -102,42 +131,126 @@ typedef enum{
  * holds the data required for the specific syntax token.
  *
  * This structure is not allowed to contain any allocated memory.
+ * Tokens are never modified once they are compiled, so they can be
+ * shared between patterns (see Program), all state is in the pattern.
  */
 typedef struct _token_t{
     token_type_t type;
     union{
         struct{rgb12 color;                            }color;
         struct{                                        }transparent;
-        struct{uint32_t sleep_time; uint32_t remaining;}sleep;
-        struct{float brightness;                       }brightness;
+        struct{int32_t hue;                            }hue; // HSV_HUE_MAX == 360 degrees
+        struct{int32_t kelvin; bool relative;          }kelvin;
+        struct{uint32_t sleep_time; bool ms;           }sleep; // ticks or milliseconds
+        struct{int32_t brightness;                     }brightness; // Q16
         struct{                                        }increment;
         struct{                                        }decrement;
         struct{                                        }forever;
-        struct{uint16_t new_pp;                        }jump;
+        struct{uint16_t new_pp;                        }jump; // also used by pREPEAT_END
         struct{                                        }mark;
-        struct{int16_t value;                          }push;
+        struct{uint32_t value;                         }push;
         struct{                                        }pop;
+        struct{uint16_t count;                         }repeat;
+        struct{struct _token_t* tokens; uint16_t len;  }call;
+        struct{                                        }ret;
     };
 }token_t;
 
 
 #define MAX_STACK 10
+#define MAX_REPEAT 8 // nesting depth of counted loops
+#define MAX_CALLS 4  // nesting depth of subroutine calls
 typedef struct _pattern_base_t{
     uint16_t id;         // this is the pattern id that maps to th pattern map
     uint16_t len;
     uint16_t current;
     token_t* tokens;
+    bool shared;         // the tokens belong to a Program, they are never freed here
+    uint32_t remaining;  // remaining ticks of the current sleep
     struct{
-        int16_t stack[MAX_STACK];
+        uint32_t stack[MAX_STACK]; // wraps around on overflow
         uint8_t pos;
     }stack;
-    float brightness;    // brightness from 0 -> 1
+    struct{
+        uint16_t count[MAX_REPEAT]; // remaining iterations of the counted loops
+        uint8_t depth;
+        uint8_t yielded;          // bit n is set if iteration n did yield
+        uint8_t restart;          // bit n: iteration n starts with the next tick
+    }repeat;
+    struct{
+        struct{
+            token_t* tokens;  // tokens, len and position of the caller
+            uint16_t len;
+            uint16_t current;
+        }frame[MAX_CALLS];
+        uint8_t depth;
+    }calls;
+    int32_t brightness;  // brightness from 0 -> 65536 (Q16)
     rgb12 base_color;    // the original color value
-    rgb12 color;         // the led setting algorithm used this color,
+    hsv hsv;             // base_color in HSV, only valid if hsv_valid
+    bool hsv_valid;
+    uint16_t kelvin;     // last color temperature, 0 if none was set
+    rgb16 color;         // the led setting algorithm used this color,
                          // it is pre calculated every tick
     bool visible;
+    uint8_t blend;       // blend mode onto the patterns below
+    uint16_t alpha;      // blend opacity 0 -> 4096
 }pattern_base_t;
 
+/**
+ * A subroutine defined with define(), the tokens are shared by every
+ * pattern that calls it and are never freed, a redefinition only
+ * replaces the entry in the table.
+ */
+typedef struct _subroutine_t{
+    qstr name;
+    token_t* tokens;     // ends with pRETURN
+    uint16_t len;
+    uint8_t repeats;     // deepest nesting of counted loops, including the calls
+    uint8_t calls;       // deepest nesting of calls
+}subroutine_t;
+
+/**
+ * A placeholder of a template, the operand of the token at pos is
+ * taken from the keyword argument name when the pattern is set.
+ */
+typedef struct _template_slot_t{
+    qstr name;
+    uint16_t pos;
+}template_slot_t;
+
+#define PATTERN_FINITE   0
+#define PATTERN_INFINITE 1
+#define PATTERN_UNKNOWN  2 // the analysis gave up
+
+#define ANALYZE_MAX_STEPS 100000
+
+/**
+ * result of the static analysis of a pattern
+ */
+typedef struct _pattern_info_t{
+    uint8_t result;      // PATTERN_FINITE, PATTERN_INFINITE or PATTERN_UNKNOWN
+    uint64_t duration;   // number of ticks until a finite pattern is done
+    uint64_t max_steps;  // most tokens executed in a single tick
+}pattern_info_t;
+
+/**
+ * A compiled pattern, the tokens are immutable and are shared by every
+ * pattern that runs the program, so they are never freed by the patterns
+ */
+typedef struct _tlc5947_program_obj_t{
+    mp_obj_base_t base;
+    uint16_t len;
+    token_t* tokens;
+    pattern_info_t info;
+    struct{
+        template_slot_t* list;
+        uint16_t len;
+    }slots; // the placeholders, every pattern gets a patched copy of the tokens
+}tlc5947_program_obj_t;
+
+extern const mp_obj_type_t tlc5947_program_type;
+
 typedef struct _tlc5947_tlc5947_obj_t{
     // base represents some basic information, like type
     mp_obj_base_t base;
@@ -145,12 +258,106 @@ typedef struct _tlc5947_tlc5947_obj_t{
     mp_obj_base_t*   spi;     // spi peripheral to use
     mp_hal_pin_obj_t blank;   // blank high -> all outputs off
     mp_hal_pin_obj_t xlat;    // low -> high transition GSR shift
+    transfer_t transfer;      // asynchronous spi transfer, XLAT is pulsed on completion
+    bool blanked;             // BLANK is asserted, no frames are transmitted
 
-    uint8_t buffer[36];       // buffer for the led colors
-    uint8_t id_map[8];        // led index to id map
+    uint16_t len;             // number of chained tlc5947 devices
+    uint16_t leds;            // number of rgb leds (8 per device)
+    /**
+     * The led colors are double buffered (36 bytes per device each),
+     * new frames are assembled in the back buffer while the front
+     * buffer is shifted out, the buffers are swapped at XLAT.
+     */
+    uint8_t* front;           // buffer that is transmitted / latched
+    uint8_t* back;            // buffer the next frame is assembled in
+    uint16_t* id_map;         // led index to id map
     white_balance_matrix white_m; // white balance matrix
     gamut_matrix gamut_m;         // gamut balance matrix
 
+    /**
+     * Calibration profiles, every led refers to one of the profiles
+     * by index. The profiles are stored as the combined fixed point
+     * matrix so applying one costs nothing more than the matrix
+     * multiplication. profiles[0] is white_m and gamut_m combined
+     * and updated whenever either changes.
+     */
+    color_matrix profiles[TLC5947_PROFILES];
+    uint8_t* profile;             // profile index of every led
+
+    /**
+     * Master dimmer, applied to every channel after the calibration
+     * through a 12bit -> 12bit lookup table. The table is only
+     * rebuilt when the level changes, two tables are allocated once
+     * and used alternately so the frames never see a partial table.
+     */
+    struct{
+        uint16_t level;           // master level 0 -> 4095
+        uint16_t* lut;            // lookup table (12.4 fixed point output), NULL at full level
+        uint16_t* tables;         // 2 * 4096 entries, allocated at the first level change
+    }master;
+
+    /**
+     * Temporal dithering, the fractional part of the calibrated 12.4
+     * fixed point color is accumulated per channel and spread over
+     * successive frames.
+     */
+    struct{
+        uint8_t (*error)[3];      // accumulated fractional part per channel, NULL if dithering is off
+    }dither;
+
+    /**
+     * Power limiter, the duty cycles of all channels in the frame are
+     * summed up and when the sum exceeds the budget the whole frame
+     * is scaled down proportionally. The sum is maintained
+     * incrementally from the led's that changed.
+     */
+    struct{
+        uint32_t budget;          // maximum sum of all duty cycles (4095 per channel), 0 if off
+        uint32_t load;            // sum of all duty cycles in the frame
+        uint32_t scale;           // scale applied to the frame (Q16)
+        uint16_t* leds;           // sum of the duty cycles of every led
+    }power;
+
+    const uint16_t* curve;        // brightness curve used by the patterns
+    uint16_t* user_curve;         // user supplied brightness curve, NULL if not used
+
+    /**
+     * Tick rate, delays in milliseconds are converted to ticks every
+     * time they start, so a new rate also applies to the patterns that
+     * are already running.
+     */
+    struct{
+        uint32_t mhz;             // tick rate set by freq(), in mHz
+    }freq;
+
+    // subroutines that can be called by the patterns of this object, see define()
+    struct{
+        subroutine_t* list;
+        uint16_t len;
+    }subroutines;
+
+    /**
+     * Optional 2D addressing layer, the (x, y) -> led index table is
+     * compiled once by set_matrix(), so resolving a coordinate is a
+     * single lookup.
+     */
+    struct{
+        uint16_t width;       // logical width (after rotation)
+        uint16_t height;      // logical height (after rotation)
+        uint16_t* map;        // map[y * width + x] = led index, NULL if not configured
+    }matrix;
+
+    /**
+     * Frame streaming mode, while active the pattern engine is bypassed
+     * and __call__ only transmits the frames written by write_frame().
+     */
+    struct{
+        bool active;          // streaming mode is active
+        bool pending;         // a new frame is waiting to be transmitted
+        mp_obj_t raw;         // RAW frame object, transmitted without copying, MP_OBJ_NULL if none
+        mp_obj_t sent;        // RAW frame object of the last transfer, kept until it is done
+    }frame;
+
     struct{
         /**
          * This is the list of all currently used patterns.
@@ -160,7 +367,7 @@ typedef struct _tlc5947_tlc5947_obj_t{
          * from the corresponding pattern entry
          */
         struct{
-            uint8_t len;          // length of the pattern list
+            uint16_t len;         // length of the pattern list
             uint16_t pid;         // current pattern id (next pid = current pid + 1)
             pattern_base_t* list; // list of currently used patterns
         }patterns;
@@ -173,10 +380,19 @@ typedef struct _tlc5947_tlc5947_obj_t{
          * overwritten and deleted reliably.
          */
         struct{
-            uint8_t len;          // length of the current pattern stack
+            uint16_t len;         // length of the current pattern stack
             uint16_t* map;        // pattern stack, mapping patterns to leds
-        }pattern_map[8];
+        }*pattern_map;            // one pattern stack per led
+
+        /**
+         * The color of every led as resolved from the patterns, before
+         * the calibration is applied. Only led's whose color differs
+         * from this are calibrated and encoded again.
+         */
+        rgb16* colors;
+        rgb16* output;            // calibrated color of every led
         bool changed;
+        bool recalibrate;         // the calibration changed, all led's are dirty
     }data;
     volatile uint8_t lock;
 }tlc5947_tlc5947_obj_t;
@@ -240,7 +456,7 @@ static void dump_pattern(pattern_base_t* pattern){
             "id: %d\r\n"
             "len: %d\r\n"
             "stack.pos: %d\r\n",
-            pattern->color.r,pattern->color.g,pattern->color.b,
+            pattern->color.r >> 8,pattern->color.g >> 8,pattern->color.b >> 8,
             (unsigned int)pattern->current,
             pattern->id,
             (unsigned int)pattern->len,
@@ -251,6 +467,8 @@ static void dump_pattern(pattern_base_t* pattern){
         switch(pattern->tokens[i].type){
         case pCOLOR:      {dprintf("pCOLOR\r\n");     break;}
         case pTRANSPARENT:{dprintf("pTRANSPARENT");   break;}
+        case pHUE:        {dprintf("pHUE\r\n");       break;}
+        case pKELVIN:     {dprintf("pKELVIN\r\n");    break;}
         case pSLEEP:      {dprintf("pSLEEP\r\n");     break;}
         case pBRIGHTNESS: {dprintf("pBRIGHTNESS\r\n");break;}
         case pINCREMENT:  {dprintf("pINCREMENT\r\n"); break;}
@@ -260,6 +478,10 @@ static void dump_pattern(pattern_base_t* pattern){
         case pMARK:       {dprintf("pMARK\r\n");      break;}
         case pPUSH:       {dprintf("pPUSH\r\n");      break;}
         case pPOP:        {dprintf("pPOP\r\n");       break;}
+        case pREPEAT:     {dprintf("pREPEAT\r\n");    break;}
+        case pREPEAT_END: {dprintf("pREPEAT_END\r\n");break;}
+        case pCALL:       {dprintf("pCALL\r\n");      break;}
+        case pRETURN:     {dprintf("pRETURN\r\n");    break;}
         default:          {dprintf("pDEFAULT\r\n");   break;}
         }
     }
@@ -268,7 +490,7 @@ static void dump_pattern(pattern_base_t* pattern){
 
 static void dump_pattern_map(tlc5947_tlc5947_obj_t* self){
     dprintf("dump_pattern_map:\r\n");
-    for(size_t i = 0; i < 8; i++){
+    for(size_t i = 0; i < self->leds; i++){
         dprintf("led %d, len = %d:", (unsigned)i, self->data.pattern_map[i].len);
         for(size_t j = 0; j < self->data.pattern_map[i].len; j++){
             dprintf(" %d", self->data.pattern_map[i].map[j]);
@@ -288,25 +510,162 @@ static const token_t fixed_forever_token = {
     .type = pFOREVER
 };
 
+static void free_tokens(pattern_base_t* pattern){
+    // inside of a subroutine the own tokens are in the first call frame
+    if(pattern->calls.depth){
+        pattern->tokens = pattern->calls.frame[0].tokens;
+        pattern->calls.depth = 0;
+    }
+    if((pattern->tokens != &fixed_forever_token) && !pattern->shared)
+        m_free(pattern->tokens);
+    pattern->shared = false;
+}
+
 
 static float clamp(float d, float min, float max) {
     const float t = d < min ? min : d;
     return t > max ? max : t;
 }
 
-static rgb12 adjust_color(tlc5947_tlc5947_obj_t* self, rgb12 c){
-    return rgb12_gamut(rgb12_white_balance(c, self->white_m), self->gamut_m);
+static uint16_t dim_channel(tlc5947_tlc5947_obj_t* self, uint16_t v){
+    return self->master.lut[v >> 4] + (((v & 0xF) * self->master.level + 2047) / 4095);
+}
+
+static rgb16 adjust_color(tlc5947_tlc5947_obj_t* self, uint16_t led, rgb16 c){
+    c = rgb16_color_matrix(c, self->profiles[self->profile[led]]);
+
+    if(self->master.lut){
+        c.r = dim_channel(self, c.r);
+        c.g = dim_channel(self, c.g);
+        c.b = dim_channel(self, c.b);
+    }
+    return c;
+}
+
+/**
+ * adds the accumulated error to v, the integer part is
+ * the output and the fractional part is the new error
+ */
+static uint16_t dither_channel(uint16_t v, uint8_t* error){
+    v += *error;
+    *error = v & 0xF;
+    return v >> 4;
+}
+
+static rgb12 dither_color(rgb16 c, uint8_t* error){
+    rgb12 _c;
+    _c.r = dither_channel(c.r, &error[0]);
+    _c.g = dither_channel(c.g, &error[1]);
+    _c.b = dither_channel(c.b, &error[2]);
+    return _c;
+}
+
+static rgb16 scale_color(rgb16 c, uint32_t scale){
+    c.r = (c.r * scale) >> 16;
+    c.g = (c.g * scale) >> 16;
+    c.b = (c.b * scale) >> 16;
+    return c;
+}
+
+// sum of the duty cycles of all channels of c
+static uint32_t color_load(rgb16 c){
+    return ((uint32_t)c.r + c.g + c.b) >> 4;
+}
+
+// returns the scale (Q16) that keeps load within the power budget
+static uint32_t power_scale(tlc5947_tlc5947_obj_t* self, uint32_t load){
+    if(!self->power.budget || (load <= self->power.budget))
+        return 65536;
+    return (uint32_t)(((uint64_t)self->power.budget << 16) / load);
+}
+
+/**
+ * marks all led's dirty, the new calibration is
+ * applied to all led's on the next frame
+ */
+static void recalibrate(tlc5947_tlc5947_obj_t* self){
+    self->data.recalibrate = true;
+    self->data.changed = true;
+}
+
+/**
+ * recomputes the global color matrix (profile 0)
+ */
+static void update_calibration(tlc5947_tlc5947_obj_t* self){
+    color_matrix_set(self->profiles[0], self->white_m, self->gamut_m);
+    recalibrate(self);
+}
+
+/**
+ * reads a white balance matrix [r, g, b] into m
+ * returns false if one of the values is not a float
+ */
+static bool get_white_balance(mp_obj_t matrix_in, white_balance_matrix m){
+    mp_obj_t *items;
+    mp_obj_get_array_fixed_n(matrix_in, 3, &items);
+
+    for(uint32_t i = 0; i < 3; ++i){
+        mp_float_t f;
+        if(!mp_obj_get_float_maybe(items[i], &f))
+            return false;
+        m[i] = clamp(((float)f), 0.0F, 1.0F);
+    }
+    return true;
+}
+
+/**
+ * reads a 3x3 gamut matrix into m
+ * returns false if one of the values is not a float
+ */
+static bool get_gamut_matrix(mp_obj_t matrix_in, gamut_matrix m){
+    mp_obj_t *items;
+    mp_obj_get_array_fixed_n(matrix_in, 3, &items);
+
+    for(uint32_t i = 0; i < 3; ++i){
+        mp_obj_t *sub_items;
+        mp_obj_get_array_fixed_n(items[i], 3, &sub_items);
+
+        for(uint32_t j = 0; j < 3; ++j){
+            mp_float_t f;
+            if(!mp_obj_get_float_maybe(sub_items[j], &f))
+                return false;
+            m[i][j] = clamp(((float)f), 0.0F, 1.0F);
+        }
+    }
+    return true;
+}
+
+/**
+ * returns the number of ticks of a delay, 0 if it never ends,
+ * a delay in milliseconds takes at least 1 tick
+ */
+static uint32_t sleep_ticks(const token_t* p, uint32_t mhz){
+    if(!p->sleep.ms)
+        return p->sleep.sleep_time;
+
+    // ms * mHz is 10^6 times the number of ticks
+    uint64_t ticks = ((uint64_t)p->sleep.sleep_time * mhz + 500000) / 1000000;
+    if(!ticks)
+        return 1;
+    return (ticks > UINT32_MAX) ? UINT32_MAX : (uint32_t)ticks;
 }
 
 // returns true if the pattern is done
 static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern){
+    // every open counted loop iteration has yielded, except one that starts now
+    pattern->repeat.yielded = ~pattern->repeat.restart;
+    pattern->repeat.restart = 0;
+
     while(true){
         token_t* p = &pattern->tokens[pattern->current];
         switch(p->type){
         case pCOLOR:{      // change color
             tprintf("pCOLOR\r\n");
-            pattern->base_color = pattern->color = adjust_color(self, p->color.color);
-            pattern->brightness = 1.0F;
+            pattern->base_color = p->color.color;
+            pattern->brightness = 65536;
+            pattern->kelvin = 0; // the color is no blackbody anymore
+            pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness, self->curve);
+            pattern->hsv_valid = false;
             self->data.changed = true;
             pattern->current++;
             if(pattern->current == pattern->len)
@@ -324,13 +683,65 @@ static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern
             continue;
         }
 
+        case pHUE:{        // rotate the hue
+            tprintf("pHUE\r\n");
+            self->data.changed = true;
+
+            if(!pattern->hsv_valid){
+                pattern->hsv = rgb12tohsv(pattern->base_color);
+                pattern->hsv_valid = true;
+            }
+
+            int32_t h = pattern->hsv.h + p->hue.hue;
+            if(h < 0)
+                h += HSV_HUE_MAX;
+            else if(h >= HSV_HUE_MAX)
+                h -= HSV_HUE_MAX;
+            pattern->hsv.h = h;
+
+            pattern->base_color = hsvtorgb12(pattern->hsv);
+            pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness, self->curve);
+
+            pattern->current++;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
+            continue;
+        }
+
+        case pKELVIN:{     // change color temperature
+            tprintf("pKELVIN\r\n");
+            self->data.changed = true;
+
+            int32_t k = p->kelvin.kelvin;
+            if(p->kelvin.relative){
+                // relative changes start at 6500K if no temperature was set
+                k += pattern->kelvin ? pattern->kelvin : 6500;
+                if(k < KELVIN_MIN)
+                    k = KELVIN_MIN;
+                else if(k > KELVIN_MAX)
+                    k = KELVIN_MAX;
+            }else{
+                pattern->brightness = 65536;
+            }
+            pattern->kelvin = k;
+            pattern->hsv_valid = false;
+
+            pattern->base_color = kelvintorgb12(k);
+            pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness, self->curve);
+
+            pattern->current++;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
+            continue;
+        }
+
         case pSLEEP:{      // sleep for x amount of ticks
             tprintf("pSLEEP\r\n");
-            if(!p->sleep.remaining){
-                p->sleep.remaining = p->sleep.sleep_time;
+            if(!pattern->remaining){
+                pattern->remaining = sleep_ticks(p, self->freq.mhz);
             }else{
-                p->sleep.remaining--;
-                if(!p->sleep.remaining){
+                pattern->remaining--;
+                if(!pattern->remaining){
                     pattern->current++;
                     if(pattern->current == pattern->len)
                         return true; // pattern is done, no more tokens
@@ -344,9 +755,13 @@ static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern
             tprintf("pBRIGHTNESS\r\n");
             self->data.changed = true;
 
-            pattern->brightness = clamp(pattern->brightness + p->brightness.brightness, 0.0F, 1.0F);
+            pattern->brightness += p->brightness.brightness;
+            if(pattern->brightness < 0)
+                pattern->brightness = 0;
+            else if(pattern->brightness > 65536)
+                pattern->brightness = 65536;
 
-            pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness);
+            pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness, self->curve);
 
             pattern->current++;
             if(pattern->current == pattern->len)
@@ -375,7 +790,7 @@ static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern
         case pFOREVER:{  // stay here for ever
             tprintf("pFOREVER\r\n");
             if(pattern->tokens != &fixed_forever_token){
-                m_free(pattern->tokens);
+                free_tokens(pattern);
                 pattern->tokens = (token_t*)&fixed_forever_token;
                 pattern->len = 1;
                 pattern->current = 0;
@@ -409,6 +824,8 @@ static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern
                 return true;
             pattern->stack.stack[pattern->stack.pos] = p->push.value;
             pattern->current++;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
             continue;
         }
 
@@ -418,6 +835,59 @@ static bool pattern_do_tick(tlc5947_tlc5947_obj_t* self, pattern_base_t* pattern
                 return true;
             pattern->stack.pos--;
             pattern->current++;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
+            continue;
+        }
+
+        case pREPEAT:{      // start a counted loop, the depth is checked by the compiler
+            tprintf("pREPEAT\r\n");
+            pattern->repeat.yielded &= ~(1 << pattern->repeat.depth);
+            pattern->repeat.count[pattern->repeat.depth++] = p->repeat.count;
+            pattern->current++;
+            continue;
+        }
+
+        case pREPEAT_END:{  // next iteration of the counted loop
+            tprintf("pREPEAT_END\r\n");
+            if(--pattern->repeat.count[pattern->repeat.depth - 1]){
+                uint8_t bit = 1 << (pattern->repeat.depth - 1);
+                pattern->current = p->jump.new_pp;
+                if(pattern->repeat.yielded & bit){
+                    pattern->repeat.yielded &= ~bit;
+                    continue;
+                }
+                // like ], an iteration without a delay ends the tick
+                pattern->repeat.restart = bit;
+                return false;
+            }
+            pattern->repeat.depth--;
+            pattern->current++;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
+            continue;
+        }
+
+        case pCALL:{        // call a subroutine, the depth is checked by the compiler
+            tprintf("pCALL\r\n");
+            pattern->calls.frame[pattern->calls.depth].tokens  = pattern->tokens;
+            pattern->calls.frame[pattern->calls.depth].len     = pattern->len;
+            pattern->calls.frame[pattern->calls.depth].current = pattern->current + 1;
+            pattern->calls.depth++;
+            pattern->tokens  = p->call.tokens;
+            pattern->len     = p->call.len;
+            pattern->current = 0;
+            continue;
+        }
+
+        case pRETURN:{      // return to the caller
+            tprintf("pRETURN\r\n");
+            pattern->calls.depth--;
+            pattern->tokens  = pattern->calls.frame[pattern->calls.depth].tokens;
+            pattern->len     = pattern->calls.frame[pattern->calls.depth].len;
+            pattern->current = pattern->calls.frame[pattern->calls.depth].current;
+            if(pattern->current == pattern->len)
+                return true; // pattern is done, no more tokens
             continue;
         }
 
@@ -439,7 +909,7 @@ static bool delete_pattern(tlc5947_tlc5947_obj_t* self, uint16_t pid){
     self->data.changed = true;
 
     // first delete all references in the pattern map
-    for(uint16_t i = 0; i < 8; i++){ // iterate over all 8 pattern maps (i)
+    for(uint16_t i = 0; i < self->leds; i++){ // iterate over all pattern maps (i)
         if(self->data.pattern_map[i].map){ // if this pattern map exists
             for(uint16_t j = 0; j < self->data.pattern_map[i].len; j++){ // iterate over all id's in this map
                 if(self->data.pattern_map[i].map[j] == pid){ // if this id matches the to be deleted id
@@ -473,8 +943,7 @@ static bool delete_pattern(tlc5947_tlc5947_obj_t* self, uint16_t pid){
             LOCK(self);
 
             // deallocate the token list
-            if(self->data.patterns.list[i].tokens != &fixed_forever_token)
-                m_free(self->data.patterns.list[i].tokens);
+            free_tokens(&self->data.patterns.list[i]);
             self->data.patterns.list[i].tokens = NULL;
 
             self->data.patterns.len--;
@@ -502,16 +971,120 @@ static bool delete_pattern(tlc5947_tlc5947_obj_t* self, uint16_t pid){
     return false;
 }
 
-static bool get_led_from_id_map(tlc5947_tlc5947_obj_t* self, uint8_t led_in, uint8_t* led){
-    if(led_in >= 8)
+static bool get_led_from_id_map(tlc5947_tlc5947_obj_t* self, int led_in, uint16_t* led){
+    if((led_in < 0) || (led_in >= self->leds))
         return false;
-    if(self->id_map[led_in] == 0xFF)
+    if(self->id_map[led_in] == 0xFFFF)
         return false;
 
     *led = self->id_map[led_in];
     return true;
 }
 
+static bool get_led_from_matrix(tlc5947_tlc5947_obj_t* self, int x, int y, uint16_t* led){
+    if(!self->matrix.map)
+        return false;
+    if((x < 0) || (x >= self->matrix.width) || (y < 0) || (y >= self->matrix.height))
+        return false;
+
+    return get_led_from_id_map(self, self->matrix.map[y * self->matrix.width + x], led);
+}
+
+/**
+ * resolves a single led argument, this can either be an int (led index)
+ * or a (x, y) tuple if a matrix is configured
+ */
+static uint16_t get_led(tlc5947_tlc5947_obj_t* self, mp_obj_t led_in){
+    uint16_t led;
+    if(mp_obj_is_type(led_in, &mp_type_tuple)){
+        mp_obj_t* items;
+        mp_obj_get_array_fixed_n(led_in, 2, &items);
+        if(!get_led_from_matrix(self, mp_obj_get_int(items[0]), mp_obj_get_int(items[1]), &led))
+            mp_raise_ValueError(MP_ERROR_TEXT("led not in matrix"));
+    }else if(!get_led_from_id_map(self, mp_obj_get_int(led_in), &led)){
+        mp_raise_ValueError(MP_ERROR_TEXT("led not in id_map"));
+    }
+    return led;
+}
+
+/**
+ * resolves the led argument of set() to a list of led indexes
+ *   int           a single led
+ *   [int, ...]    a list of leds
+ *   (x, y)        a single led in the matrix
+ *   (x, y, w, h)  a rectangular region of the matrix
+ * the returned list is allocated with m_malloc, len is set to its length
+ */
+static uint16_t* get_leds(tlc5947_tlc5947_obj_t* self, mp_obj_t led_in, size_t* len){
+    uint16_t* leds;
+
+    if(mp_obj_is_int(led_in)){
+        leds = m_malloc(sizeof(uint16_t));
+        leds[0] = get_led(self, led_in);
+        *len = 1;
+    }else if(mp_obj_is_type(led_in, &mp_type_list)){
+        mp_obj_t* list;
+        mp_obj_get_array(led_in, len, &list);
+        leds = m_malloc(*len * sizeof(uint16_t));
+
+        for(size_t i = 0; i < *len; i++){
+            int tmpled;
+            if(!mp_obj_get_int_maybe(list[i], &tmpled)){
+                m_free(leds);
+                mp_raise_TypeError(MP_ERROR_TEXT("expected list of int"));
+            }
+            if(!get_led_from_id_map(self, tmpled, &leds[i])){
+                m_free(leds);
+                mp_raise_ValueError(MP_ERROR_TEXT("led not in id_map"));
+            }
+        }
+    }else if(mp_obj_is_type(led_in, &mp_type_tuple)){
+        mp_obj_t* items;
+        size_t n;
+        mp_obj_get_array(led_in, &n, &items);
+
+        if(n == 2){
+            leds = m_malloc(sizeof(uint16_t));
+            leds[0] = get_led(self, led_in);
+            *len = 1;
+        }else if(n == 4){
+            int x = mp_obj_get_int(items[0]);
+            int y = mp_obj_get_int(items[1]);
+            int w = mp_obj_get_int(items[2]);
+            int h = mp_obj_get_int(items[3]);
+
+            if(!self->matrix.map || (w <= 0) || (h <= 0) || (x < 0) || (y < 0) ||
+               ((x + w) > self->matrix.width) || ((y + h) > self->matrix.height))
+                mp_raise_ValueError(MP_ERROR_TEXT("region not in matrix"));
+
+            *len = w * h;
+            leds = m_malloc(*len * sizeof(uint16_t));
+            for(int j = 0; j < h; j++){
+                for(int i = 0; i < w; i++){
+                    if(!get_led_from_matrix(self, x + i, y + j, &leds[j * w + i])){
+                        m_free(leds);
+                        mp_raise_ValueError(MP_ERROR_TEXT("led not in id_map"));
+                    }
+                }
+            }
+        }else{
+            mp_raise_TypeError(MP_ERROR_TEXT("expected (x, y) or (x, y, w, h)"));
+        }
+    }else{
+        mp_raise_TypeError(MP_ERROR_TEXT("expected int or list of int"));
+    }
+
+    return leds;
+}
+
+/**
+ * The device closest to the MCU is shifted out last, so it occupies
+ * the last 36 bytes of the buffer, the led's 0-7 are on this device.
+ */
+static inline size_t get_device_offset(tlc5947_tlc5947_obj_t* self, uint16_t led){
+    return 36 * (self->len - 1 - (led / 8));
+}
+
 static const uint8_t lut[] = {0,4,9,13,18,22,27,31};
 static void set_buffer(uint8_t* buf, int led, rgb12 c){
     if(!(led % 2)){
@@ -543,9 +1116,34 @@ static rgb12 get_buffer(const uint8_t* buf, int led){
     return c;
 }
 
-static const rgb12 BLACK = {.r = 0, .g = 0, .b = 0};
-static bool do_tick(tlc5947_tlc5947_obj_t* self){
-    // first update all patterns, and delete finished patterns
+/**
+ * frame formats accepted by write_frame()
+ */
+typedef enum{
+    FRAME_RGB8,   // 3 bytes per led
+    FRAME_RGB12,  // 3 x 16bit values per led, only the lower 12 bits are used
+    FRAME_RAW     // 36 bytes per device, already in the shift register format
+}frame_format_t;
+
+/**
+ * number of led's in a frame, the frame is in matrix order if
+ * a matrix is configured, otherwise in led index order
+ */
+static size_t get_frame_leds(tlc5947_tlc5947_obj_t* self){
+    if(self->matrix.map)
+        return self->matrix.width * self->matrix.height;
+    return self->leds;
+}
+
+static bool get_led_from_frame(tlc5947_tlc5947_obj_t* self, size_t i, uint16_t* led){
+    if(self->matrix.map)
+        return get_led_from_id_map(self, self->matrix.map[i], led);
+    return get_led_from_id_map(self, i, led);
+}
+
+static const rgb16 BLACK = {.r = 0, .g = 0, .b = 0};
+// update all patterns, and delete finished patterns
+static void do_tick(tlc5947_tlc5947_obj_t* self){
     if(self->data.patterns.list){
         for(uint16_t i = 0; i < self->data.patterns.len; i++){
             if(pattern_do_tick(self, &self->data.patterns.list[i])){
@@ -553,153 +1151,153 @@ static bool do_tick(tlc5947_tlc5947_obj_t* self){
             }
         }
     }
+}
 
-    if(self->data.changed){
-        // now that all patterns are updated, get the latest of all patterns and update the led buffer
-        for(uint16_t led = 0; led < 8; led++){
-            rgb12 color = BLACK;
+static pattern_base_t* find_pattern(tlc5947_tlc5947_obj_t* self, uint16_t pid){
+    for(uint16_t i = 0; i < self->data.patterns.len; i++)
+        if(self->data.patterns.list[i].id == pid)
+            return &self->data.patterns.list[i];
+    return NULL;
+}
 
-            // find the matching pattern
-            if(self->data.pattern_map[led].map){
-                // current pid for this led
-                uint16_t pid_pos = self->data.pattern_map[led].len-1;
+/**
+ * writes the calibrated color of a led to the buffer,
+ * with the power limit and dithering applied
+ */
+static void encode_led(tlc5947_tlc5947_obj_t* self, uint16_t led){
+    rgb16 c = self->data.output[led];
+    if(self->power.scale != 65536)
+        c = scale_color(c, self->power.scale);
+
+    rgb12 out;
+    if(self->dither.error)
+        out = dither_color(c, self->dither.error[led]);
+    else
+        out = rgb16torgb12(c);
+    set_buffer(self->back + get_device_offset(self, led), led % 8, out);
+}
 
-                bool done = false;
-                while(!done){
-                    uint16_t pid = self->data.pattern_map[led].map[pid_pos];
-                    for(uint16_t j = 0; j < self->data.patterns.len; j++){
-                        if(self->data.patterns.list[j].id == pid){
-                            color = self->data.patterns.list[j].color;
+/**
+ * composes the color of a led from its pattern stack
+ */
+static rgb16 get_led_color(tlc5947_tlc5947_obj_t* self, uint16_t led){
+    uint16_t* map = self->data.pattern_map[led].map;
+    if(!map)
+        return BLACK;
 
-                            if(self->data.patterns.list[j].visible || (pid_pos == 0))
-                                done = true;
-                            --pid_pos;
-                            break;
-                        }
-                    }
-                }
-            }
+    /**
+     * walk down the pattern stack until the first opaque pattern,
+     * or the bottom, everything below it is covered.
+     */
+    uint16_t top = self->data.pattern_map[led].len - 1;
+    uint16_t base = top;
+    pattern_base_t* pattern = NULL;
+    while(true){
+        pattern = find_pattern(self, map[base]);
+        if(!base || (pattern && pattern->visible && (pattern->blend == BLEND_NORMAL)))
+            break;
+        --base;
+    }
 
-            set_buffer(self->buffer, led, color);
-        }
+    /**
+     * and blend the patterns above it on top of it. A NORMAL bottom
+     * pattern is used even if it is transparent, like without blend
+     * modes, any other bottom pattern is blended on black.
+     */
+    rgb16 color = BLACK;
+    uint16_t pos = base;
+    if(pattern && (pattern->visible || !base) && (pattern->blend == BLEND_NORMAL)){
+        color = pattern->color;
+        pos++;
+    }
+    for(; pos <= top; pos++){
+        pattern = find_pattern(self, map[pos]);
+        if(pattern && pattern->visible)
+            color = rgb16_blend(color, pattern->color, pattern->blend, pattern->alpha);
     }
-    return self->data.changed;
+    return color;
 }
 
 /**
- * This function checks if all the jumps ([]) in the string are balanced.
- * If this is not the case, this pattern is invalid
+ * get the latest color of all patterns and update the led buffer,
+ * the calibration is applied here on the output stage, to every led
+ * whose color changed, or to all led's if the calibration changed.
  */
-static bool check_balanced_jumps(const char* s){
-    int bc = 0;
+static void update_buffer(tlc5947_tlc5947_obj_t* self){
+    for(uint16_t led = 0; led < self->leds; led++){
+        rgb16 color = get_led_color(self, led);
 
-    while(*s){
-        switch(*s++){
-        case '[':
-            bc++;
-            break;
+        if(self->data.recalibrate || !rgb16_equal(color, self->data.colors[led])){
+            self->data.colors[led] = color;
+            rgb16 output = adjust_color(self, led, color);
+            self->data.output[led] = output;
 
-        case ']':
-            if(!bc) // there was no matching opening bracet
-                return false;
-            bc--;
-            break;
+            uint16_t load = color_load(output);
+            self->power.load = self->power.load - self->power.leds[led] + load;
+            self->power.leds[led] = load;
 
-        default:
-            break;
+            if(!self->dither.error)
+                encode_led(self, led);
         }
     }
 
-    if(bc) // to many opening bracets
-        return false;
-    return true;
+    // all led's have to be encoded again if the power limiter changed the scale
+    uint32_t scale = power_scale(self, self->power.load);
+    if(self->dither.error || (scale != self->power.scale)){
+        self->power.scale = scale;
+        for(uint16_t led = 0; led < self->leds; led++)
+            encode_led(self, led);
+    }
+    self->data.recalibrate = false;
 }
 
 static inline int isdigit(int c){return ((c>='0')&&(c<='9'));}
 static inline int isxdigit(int c){return (isdigit(c) || ((c>='A')&&(c<='F')) || ((c>='a')&&(c<='f')));}
 
+// skips a decimal number without sign
+static const char* skip_number(const char* s){
+    while(isdigit(*s) || (*s == '.'))
+        s++;
+    return s;
+}
+
 /**
- * This function checks that all colors used
- * in this string are valid RGB.
+ * skips the "H,S,V" part of a HSV color,
+ * returns NULL if it is not valid.
  */
-static bool check_colors(const char* s){
-    while(*s){
-        switch(*s++){
-        case '#': // check that the next 6 characters are hexadecimal digits
-            for(uint16_t i = 0; i < 6; i++)
-                if(!isxdigit(s[i]))
-                    return false;
-            break;
-        default:
-            break;
+static const char* skip_hsv(const char* s){
+    for(uint8_t i = 0; i < 3; i++){
+        const char* e = skip_number(s);
+        if(e == s)
+            return NULL;
+        if(i < 2){
+            if(*e != ',')
+                return NULL;
+            e++;
         }
+        s = e;
     }
-    return true;
+    return s;
 }
 
-static size_t get_pattern_length(const char* s){
-    size_t len = 0;
-    while(*s){
-        switch(*s++){
-        case '#':
-            len++;
-            s += 6;
-            break;
-
-        case '\b':
-            if(*s == '-')
-                s++;
-            while(isdigit(*s) || (*s == '.'))
-                s++;
-            len++;
-            break;
-
-        case '|':
-        case '<':
-            while(isdigit(*s))
-                s++;
-
-            // simple tokens(no arguments)
-        case '[':
-        case ']':
-        case '+':
-        case '-':
-        case ';':
-        case '@':
-        case '>':
-            len++;
-            break;
-
-            // ignore spaces
-        case ' ':
-            break;
-
-        default:
-            mp_raise_ValueError(MP_ERROR_TEXT("Unknown character in pattern string."));
+/**
+ * parses a decimal number and skips it, returns false if it
+ * does not fit into 32 bits, v is then set to UINT32_MAX
+ */
+static bool parse_uint32(const char** s, uint32_t* v){
+    bool ok = true;
+    uint32_t k = 0;
+    for(; isdigit(**s); (*s)++){
+        uint32_t d = **s - '0';
+        if(k > ((UINT32_MAX - d) / 10)){
+            ok = false;
+            k = UINT32_MAX;
+        }else if(ok){
+            k = k * 10 + d;
         }
     }
-    if(!len)
-        mp_raise_ValueError(MP_ERROR_TEXT("Zero length pattern string"));
-    return len;
-}
-
-static void check_pattern_string(const char* pattern_str){
-    if(!check_balanced_jumps(pattern_str)){
-        mp_raise_msg(&mp_type_AttributeError, MP_ERROR_TEXT("unbalanced jumps"));
-    }
-
-    if(!check_colors(pattern_str)){
-        mp_raise_msg(&mp_type_AttributeError, MP_ERROR_TEXT("invalid color Format"));
-    }
-}
-
-static int atoi(const char *p) {
-    int k = 0;
-    while(((*p>='0')&&(*p<='9'))){
-        k = (k << 3) + (k << 1) + (*p) - '0';
-        p++;
-    }
-    return k;
+    *v = k;
+    return ok;
 }
 
 static float atof(const char *s){
@@ -755,118 +1353,819 @@ static float atof(const char *s){
     return sign ? -a : a;
 }
 
-static void tokenize_pattern_str(const char* s, token_t* pat, size_t len){
+/**
+ * The pattern compiler, the pattern string is validated, counted and
+ * tokenized in a single pass. The token array grows as needed and the
+ * jump targets are resolved with a stack of the open markers.
+ * After a ';' the rest of the string is never reached, it is still
+ * validated but no more tokens are emitted.
+ */
+typedef struct _compiler_mark_t{
+    uint16_t pos;         // position of the token, len for a mark after ';'
+    uint8_t type;         // pMARK or pREPEAT
+}compiler_mark_t;
+
+typedef struct _compiler_t{
+    token_t* tokens;      // emitted tokens
+    size_t len;           // number of emitted tokens
+    size_t size;          // number of allocated tokens
+    bool dead;            // after ';', the tokens are not emitted
+    token_t dead_token;   // receives the tokens after ';'
+    compiler_mark_t* marks; // open markers ([) and counted loops (*n()
+    size_t depth;         // number of open markers
+    size_t marks_size;    // number of allocated markers
+    size_t repeats;       // number of open counted loops
+    size_t max_repeats;   // deepest nesting of counted loops, including the calls
+    size_t max_calls;     // deepest nesting of calls
+    template_slot_t* slots; // placeholders
+    size_t slots_len;     // number of placeholders
+    size_t slots_size;    // number of allocated placeholders
+    bool templates;       // placeholders are allowed
+}compiler_t;
+
+static void compiler_free(compiler_t* c){
+    m_free(c->tokens);
+    m_free(c->marks);
+    m_free(c->slots);
+}
+
+NORETURN static void compiler_fail(compiler_t* c, const mp_obj_type_t* type, mp_rom_error_text_t msg){
+    compiler_free(c);
+    mp_raise_msg(type, msg);
+}
+
+static token_t* compiler_emit(compiler_t* c, token_type_t type){
+    if(c->dead){
+        memset(&c->dead_token, 0, sizeof(token_t));
+        c->dead_token.type = type;
+        return &c->dead_token;
+    }
+
+    if(c->len == c->size){
+        if(c->len == 0xFFFF)
+            compiler_fail(c, &mp_type_ValueError, MP_ERROR_TEXT("pattern too long"));
+
+        size_t size = c->size ? (c->size * 2) : 16;
+        if(size > 0xFFFF)
+            size = 0xFFFF;
+        token_t* tokens = m_realloc_maybe(c->tokens, sizeof(token_t) * size, true);
+        if(!tokens){
+            compiler_free(c);
+            m_malloc_fail(sizeof(token_t) * size);
+        }
+        c->tokens = tokens;
+        c->size = size;
+    }
+
+    token_t* t = &c->tokens[c->len++];
+    memset(t, 0, sizeof(token_t));
+    t->type = type;
+    return t;
+}
+
+static void compiler_push_mark(compiler_t* c, token_type_t type){
+    if(c->depth == c->marks_size){
+        size_t size = c->marks_size ? (c->marks_size * 2) : 8;
+        compiler_mark_t* marks = m_realloc_maybe(c->marks, sizeof(compiler_mark_t) * size, true);
+        if(!marks){
+            compiler_free(c);
+            m_malloc_fail(sizeof(compiler_mark_t) * size);
+        }
+        c->marks = marks;
+        c->marks_size = size;
+    }
+    c->marks[c->depth].pos  = c->len;
+    c->marks[c->depth].type = type;
+    c->depth++;
+}
+
+/**
+ * peephole optimizer, the tokens are rewritten in place without changing
+ * the output of the pattern, the new number of tokens is returned
+ *  - jumps go to the token after their marker, the markers are removed
+ *  - adjacent non zero sleeps in ticks are merged
+ *  - adjacent brightness changes with the same sign are folded
+ *  - a color followed by brightness changes and another color is removed
+ * tokens that are jump targets are never merged into the previous token,
+ * the tokens of placeholders are never changed or removed, their new
+ * positions are returned in slots.
+ */
+static size_t optimize_pattern(token_t* tokens, size_t len, template_slot_t* slots, size_t slots_len){
+    // first holds the jump targets and placeholders, then the new position of every token
+    uint16_t* map = m_malloc_maybe(sizeof(uint16_t) * len);
+    if(!map)
+        return len; // the optimization is optional
+    memset(map, 0, sizeof(uint16_t) * len);
+
+    for(size_t i = 0; i < len; i++)
+        if((tokens[i].type == pJUMP_NZERO) || (tokens[i].type == pREPEAT_END)){
+            while(tokens[tokens[i].jump.new_pp].type == pMARK)
+                tokens[i].jump.new_pp++;
+            map[tokens[i].jump.new_pp] = 1;
+        }
+
+    for(size_t i = 0; i < slots_len; i++)
+        map[slots[i].pos] |= 2;
+
+    size_t n = 0;
+    size_t fence = 0; // tokens before the fence can be a jump target
+    size_t keep = 0;  // tokens before keep are placeholders and are not touched
+    for(size_t i = 0; i < len; i++){
+        token_t t = tokens[i];
+        bool target = map[i] & 1;
+        bool slot = map[i] & 2;
+
+        if(t.type == pCOLOR){
+            // a color resets the brightness, the previous color is never shown
+            size_t k = n;
+            while((k > fence) && (k > keep) && (tokens[k - 1].type == pBRIGHTNESS))
+                k--;
+            if((k > keep) && (tokens[k - 1].type == pCOLOR))
+                n = k - 1;
+        }
+
+        map[i] = n;
+
+        if(t.type == pMARK)
+            continue;
+
+        if(target){
+            fence = n + 1;
+        }else if((n > keep) && !slot){
+            token_t* prev = &tokens[n - 1];
+
+            // sleeps in milliseconds are rounded separately, they are never merged
+            if((t.type == pSLEEP) && (prev->type == pSLEEP) && !t.sleep.ms && !prev->sleep.ms &&
+               t.sleep.sleep_time && prev->sleep.sleep_time &&
+               (t.sleep.sleep_time <= (UINT32_MAX - prev->sleep.sleep_time))){
+                prev->sleep.sleep_time += t.sleep.sleep_time;
+                continue;
+            }
+
+            // the brightness is clamped after every change, so only changes
+            // in the same direction can be added
+            if((t.type == pBRIGHTNESS) && (prev->type == pBRIGHTNESS) &&
+               ((t.brightness.brightness < 0) == (prev->brightness.brightness < 0))){
+                int32_t b = prev->brightness.brightness + t.brightness.brightness;
+                prev->brightness.brightness = b > 65536 ? 65536 : (b < -65536 ? -65536 : b);
+                continue;
+            }
+        }
+
+        tokens[n++] = t;
+        if(slot)
+            keep = n;
+    }
+
+    for(size_t i = 0; i < n; i++)
+        if((tokens[i].type == pJUMP_NZERO) || (tokens[i].type == pREPEAT_END))
+            tokens[i].jump.new_pp = map[tokens[i].jump.new_pp];
+
+    for(size_t i = 0; i < slots_len; i++)
+        slots[i].pos = map[slots[i].pos];
+
+    m_free(map);
+    return n;
+}
+
+// subroutine names, upper case letters are tokens (K) so they end the name
+static inline int isname(int c){return (isdigit(c) || ((c>='a')&&(c<='z')) || (c == '_'));}
+
+/**
+ * returns the subroutine with the name, NULL if it does not exist
+ */
+static const subroutine_t* find_subroutine(const tlc5947_tlc5947_obj_t* self, qstr name){
+    if(!self || (name == MP_QSTRnull))
+        return NULL;
+    for(uint16_t i = 0; i < self->subroutines.len; i++)
+        if(self->subroutines.list[i].name == name)
+            return &self->subroutines.list[i];
+    return NULL;
+}
+
+/**
+ * parses the placeholder "{name}" of the last emitted token,
+ * returns false if there is no placeholder
+ */
+static bool compiler_slot(compiler_t* c, const char** s){
+    if(**s != '{')
+        return false;
+
+    const char* n = *s + 1;
+    const char* e = n;
+    while(isname(*e))
+        e++;
+    if((e == n) || (*e != '}'))
+        compiler_fail(c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid placeholder Format"));
+    if(!c->templates)
+        compiler_fail(c, &mp_type_ValueError, MP_ERROR_TEXT("placeholders are not allowed here"));
+
+    *s = e + 1;
+    if(c->dead)
+        return true;
+
+    if(c->slots_len == c->slots_size){
+        size_t size = c->slots_size ? (c->slots_size * 2) : 4;
+        template_slot_t* slots = m_realloc_maybe(c->slots, sizeof(template_slot_t) * size, true);
+        if(!slots){
+            compiler_free(c);
+            m_malloc_fail(sizeof(template_slot_t) * size);
+        }
+        c->slots = slots;
+        c->slots_size = size;
+    }
+    c->slots[c->slots_len].name = qstr_from_strn(n, e - n);
+    c->slots[c->slots_len].pos  = c->len - 1;
+    c->slots_len++;
+    return true;
+}
+
+static inline int32_t hue_value(float degrees){
+    float h = clamp(degrees, -360.0F, 360.0F) * (HSV_HUE_MAX / 360.0F);
+    return (int32_t)(h + ((h < 0.0F) ? -0.5F : 0.5F)); // rounded away from 0, symmetric
+}
+
+static inline int32_t brightness_value(float brightness){
+    return (int32_t)(clamp(brightness, -1.0F, 1.0F) * 65536.0F);
+}
+
+/**
+ * compiles the pattern string into a token array,
+ * the number of tokens is returned in len
+ * @param self the subroutines of this object can be called, can be NULL
+ * @param sub  if not NULL the pattern is compiled as a subroutine,
+ *             the nesting depths are returned in sub
+ * @param slots if not NULL the pattern can contain placeholders, they are
+ *              returned in slots and slots_len, the caller frees slots
+ */
+static token_t* compile_pattern(const tlc5947_tlc5947_obj_t* self, const char* s, size_t* len, subroutine_t* sub,
+                                template_slot_t** slots, size_t* slots_len){
+    compiler_t c;
+    memset(&c, 0, sizeof(c));
+    c.templates = (slots != NULL);
+
     dprintf("parse start:\r\n");
-    for(size_t i = 0; *s && (len > i); i++){
+    while(*s){
         switch(*s++){
-        case '#':
+        case '#':{
             dprintf("RGB COLOR\r\n");
-            pat[i].type = pCOLOR;
-            pat[i].color.color = get_rgb12(--s);
-            s += 7;
+            token_t* t = compiler_emit(&c, pCOLOR);
+            if(compiler_slot(&c, &s))
+                break;
+            uint16_t n = 0;
+            while(isxdigit(s[n]) && (n < 9))
+                n++;
+            if(((n != 6) && (n != 9)) || isxdigit(s[n]))
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid color Format"));
+            // 12bit colors are used as they are, 8bit colors are expanded
+            t->color.color = (n == 9) ? get_rgb12_12bit(s - 1) : get_rgb12(s - 1);
+            s += n;
+            break;
+        }
+
+        case '$':{
+            dprintf("HSV COLOR\r\n");
+            const char* e = skip_hsv(s);
+            if(!e)
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid color Format"));
+
+            float f[3];
+            for(uint8_t j = 0; j < 3; j++){
+                f[j] = atof(s);
+                s = skip_number(s) + 1; // skip the number and the ','
+            }
+            s = e;
+
+            // the conversion is done once here, the token is a plain color
+            hsv hc;
+            // the hue is wrapped before the conversion, negative angles turn the other way
+            float h = fmodf(f[0], 360.0F);
+            if(isnan(h)) // an infinite hue
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid color Format"));
+            if(h < 0.0F)
+                h += 360.0F;
+            hc.h = ((uint32_t)(h * (HSV_HUE_MAX / 360.0F) + 0.5F)) % HSV_HUE_MAX;
+            hc.s = (uint16_t)(clamp(f[1], 0.0F, 1.0F) * 4095.0F + 0.5F);
+            hc.v = (uint16_t)(clamp(f[2], 0.0F, 1.0F) * 4095.0F + 0.5F);
+            token_t* t = compiler_emit(&c, pCOLOR);
+            t->color.color = hsvtorgb12(hc);
             break;
+        }
+
+        case '~':{
+            dprintf("HUE\r\n");
+            token_t* t = compiler_emit(&c, pHUE);
+            if(compiler_slot(&c, &s))
+                break;
+            t->hue.hue = hue_value(atof(s));
+            if(*s == '-')
+                s++;
+            s = skip_number(s);
+            break;
+        }
+
+        case 'K':{
+            dprintf("KELVIN\r\n");
+            token_t* t = compiler_emit(&c, pKELVIN);
+            if(compiler_slot(&c, &s))
+                break;
+            bool negative = (*s == '-');
+            t->kelvin.relative = negative || (*s == '+');
+            if(t->kelvin.relative)
+                s++;
+            uint32_t v;
+            parse_uint32(&s, &v); // saturated, clamped below
+            int32_t k = (v > KELVIN_MAX) ? KELVIN_MAX : (int32_t)v;
+            if(negative)
+                k = -k;
+            else if(!t->kelvin.relative && (k < KELVIN_MIN))
+                k = KELVIN_MIN;
+            t->kelvin.kelvin = k;
+            break;
+        }
 
         case '@':
             dprintf("TRANSPARENT\r\n");
-            pat[i].type = pTRANSPARENT;
+            compiler_emit(&c, pTRANSPARENT);
             break;
 
         case '\b':{
             dprintf("BRIGHTNESS\r\n");
-            pat[i].type = pBRIGHTNESS;
-            int l = 0;
+            token_t* t = compiler_emit(&c, pBRIGHTNESS);
+            if(compiler_slot(&c, &s))
+                break;
+            t->brightness.brightness = brightness_value(atof(s));
             if(*s == '-')
-                l++;
-            while(isdigit(s[l]) || (s[l] == '.'))
-                l++;
-            pat[i].brightness.brightness = atof(s);
-            s += l;
+                s++;
+            s = skip_number(s);
             break;
         }
 
         case '|':{
             dprintf("SLEEP\r\n");
-            pat[i].type = pSLEEP;
-            int l = 0;
-            while(isdigit(s[l]))
-                l++;
-            pat[i].sleep.sleep_time = atoi(s);
-            pat[i].sleep.remaining = 0;
-            s += l;
+            token_t* t = compiler_emit(&c, pSLEEP);
+            if(!compiler_slot(&c, &s) && !parse_uint32(&s, &t->sleep.sleep_time))
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("number too large"));
+            if((s[0] == 'm') && (s[1] == 's')){
+                t->sleep.ms = true;
+                s += 2;
+            }
             break;
         }
 
         case '<':{
-            pat[i].type = pPUSH;
-            int l = 0;
-            while(isdigit(s[l]))
-                l++;
-            pat[i].push.value = atoi(s);
-            s += l;
-            dprintf("PUSH %d\r\n", (int)pat[i].push.value);
+            token_t* t = compiler_emit(&c, pPUSH);
+            if(compiler_slot(&c, &s))
+                break;
+            if(!parse_uint32(&s, &t->push.value))
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("number too large"));
+            dprintf("PUSH %u\r\n", (unsigned)t->push.value);
             break;
         }
 
         case '>':
             dprintf("POP\r\n");
-            pat[i].type = pPOP;
+            compiler_emit(&c, pPOP);
             break;
 
         case '[':
             dprintf("MARK\r\n");
-            pat[i].type = pMARK;
+            compiler_push_mark(&c, pMARK);
+            compiler_emit(&c, pMARK);
             break;
 
         case ']':{
-            pat[i].type = pJUMP_NZERO;
-            int jc = 0;
-            bool f = true;
-            for(size_t j = i; j && f; j--){
-                switch(pat[j].type){
-                case pJUMP_NZERO:
-                    jc++;
-                    break;
-                case pMARK:
-                    jc--;
-                    if(!jc){
-                        pat[i].jump.new_pp = j;
-                        f = 0;
-                    }
-                    break;
-                default:
-                    break;
-                }
+            // there was no matching opening bracet, or a counted loop is still open
+            if(!c.depth || (c.marks[c.depth - 1].type != pMARK))
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("unbalanced jumps"));
+            token_t* t = compiler_emit(&c, pJUMP_NZERO);
+            t->jump.new_pp = c.marks[--c.depth].pos;
+            dprintf("JNZ %d\r\n", (int)t->jump.new_pp);
+            break;
+        }
+
+        case '*':{
+            dprintf("REPEAT\r\n");
+            if(!isdigit(*s))
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid repeat Format"));
+            uint32_t count;
+            parse_uint32(&s, &count); // saturated, checked below
+            if(*s++ != '(')
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("invalid repeat Format"));
+            if(count > 0xFFFF)
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("repeat count too large"));
+            if(c.repeats == MAX_REPEAT)
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("repeats nested too deep"));
+            c.repeats++;
+            if(!c.dead && (c.repeats > c.max_repeats))
+                c.max_repeats = c.repeats;
+            compiler_push_mark(&c, pREPEAT);
+            token_t* t = compiler_emit(&c, pREPEAT);
+            t->repeat.count = count;
+            break;
+        }
+
+        case ')':{
+            if(!c.depth || (c.marks[c.depth - 1].type != pREPEAT))
+                compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("unbalanced repeats"));
+            uint16_t start = c.marks[--c.depth].pos;
+            c.repeats--;
+            if((start < c.len) && !c.tokens[start].repeat.count){
+                c.len = start; // the body is never executed, a ';' in it too
+                c.dead = false;
+                while(c.slots_len && (c.slots[c.slots_len - 1].pos >= start))
+                    c.slots_len--;
+                break;
             }
-            dprintf("JNZ %d\r\n", (int)pat[i].jump.new_pp);
+            token_t* t = compiler_emit(&c, pREPEAT_END);
+            t->jump.new_pp = start + 1;
+            dprintf("REPEAT_END %d\r\n", (int)t->jump.new_pp);
+            break;
+        }
+
+        case '^':{
+            dprintf("CALL\r\n");
+            const char* e = s;
+            while(isname(*e))
+                e++;
+            const subroutine_t* callee = find_subroutine(self, (e != s) ? qstr_find_strn(s, e - s) : MP_QSTRnull);
+            if(!callee)
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("unknown subroutine"));
+            if((c.repeats + callee->repeats) > MAX_REPEAT)
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("repeats nested too deep"));
+            // a subroutine needs one more call frame when it is called itself
+            if((callee->calls + 1u) > (sub ? (MAX_CALLS - 1u) : MAX_CALLS))
+                compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("calls nested too deep"));
+            if(!c.dead && ((c.repeats + callee->repeats) > c.max_repeats))
+                c.max_repeats = c.repeats + callee->repeats;
+            if(!c.dead && ((callee->calls + 1u) > c.max_calls))
+                c.max_calls = callee->calls + 1;
+            token_t* t = compiler_emit(&c, pCALL);
+            t->call.tokens = callee->tokens;
+            t->call.len    = callee->len;
+            s = e;
             break;
         }
 
         case '+':
             dprintf("INCREMENT\r\n");
-            pat[i].type = pINCREMENT;
+            compiler_emit(&c, pINCREMENT);
             break;
 
         case '-':
             dprintf("DECREMENT\r\n");
-            pat[i].type = pDECREMENT;
+            compiler_emit(&c, pDECREMENT);
             break;
 
         case ';':
             dprintf("LOOP FOREVER\r\n");
-            pat[i].type = pFOREVER;
-            return; // we are done
+            compiler_emit(&c, pFOREVER);
+            c.dead = true; // everything after this is never reached
+            break;
 
         case ' ':
             // ignore spaces
             break;
 
         default:
-            // should have been caught by get_pattern_length ?
-            mp_raise_ValueError(MP_ERROR_TEXT("Unknown character in pattern string."));
-            break;
+            compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("Unknown character in pattern string."));
         }
     }
     dprintf("parse done\r\n");
+
+    // to many opening bracets
+    if(c.depth){
+        if(c.repeats)
+            compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("unbalanced repeats"));
+        compiler_fail(&c, &mp_type_AttributeError, MP_ERROR_TEXT("unbalanced jumps"));
+    }
+
+    if(!c.len)
+        compiler_fail(&c, &mp_type_ValueError, MP_ERROR_TEXT("Zero length pattern string"));
+
+    if(sub){
+        c.dead = false;
+        compiler_emit(&c, pRETURN);
+        sub->repeats = c.max_repeats;
+        sub->calls   = c.max_calls;
+    }
+
+    m_free(c.marks);
+
+    if(TLC5947_OPTIMIZE)
+        c.len = optimize_pattern(c.tokens, c.len, c.slots, c.slots_len);
+
+    if(slots){
+        *slots = c.slots;
+        *slots_len = c.slots_len;
+    }
+
+    // release the unused tokens
+    token_t* tokens = m_realloc_maybe(c.tokens, sizeof(token_t) * c.len, false);
+    *len = c.len;
+    return tokens ? tokens : c.tokens;
+}
+
+static uint64_t add_saturate(uint64_t a, uint64_t b){
+    return (a + b < a) ? UINT64_MAX : a + b;
+}
+
+static uint64_t mul_saturate(uint64_t a, uint64_t b){
+    return (b && (a > UINT64_MAX / b)) ? UINT64_MAX : a * b;
+}
+
+/**
+ * returns the number of iterations i > 0 until a loop counter that
+ * starts at v and changes by delta every iteration is 0 (mod 2^32),
+ * returns 0 if it never becomes 0
+ */
+static uint64_t loop_iterations(uint32_t v, int32_t delta){
+    uint32_t d = delta;
+    if(!d)
+        return 0;
+
+    // i * d == -v, with d = odd * 2^shift, -v has to be a multiple of 2^shift
+    uint32_t shift = 0;
+    while(!(d & 1)){
+        d >>= 1;
+        shift++;
+    }
+    if(v & ((1u << shift) - 1))
+        return 0;
+
+    // inverse of the odd part mod 2^32, every step doubles the correct bits
+    uint32_t inv = d;
+    for(uint8_t k = 0; k < 4; k++)
+        inv *= 2 - d * inv;
+
+    uint32_t mask = UINT32_MAX >> shift;
+    uint32_t i = (((0u - v) >> shift) * inv) & mask;
+    return i ? i : ((uint64_t)mask + 1); // v is 0, a full cycle
+}
+
+/**
+ * static analysis of a compiled pattern, the control flow does not depend
+ * on the colors, so it is simulated tick by tick without any output.
+ *
+ * A loop iteration that never pops below the level of its jump, and does
+ * not test that level with another jump, does not depend on the counter.
+ * After one such iteration all remaining iterations are skipped at once,
+ * so the analysis time does not grow with the loop counts.
+ * The same is done for counted loops, once an iteration starts with the
+ * same stack as the iteration before it.
+ * Delays in milliseconds are converted with the tick rate mhz.
+ */
+static void analyze_pattern(const token_t* tokens, size_t len, uint32_t mhz, pattern_info_t* info){
+    struct{
+        bool valid;
+        const token_t* jump; // the jump that closes the loop
+        int32_t delta;   // change of the counter during the iteration
+        uint64_t start;  // tick the iteration started
+    }loops[MAX_STACK];
+    memset(loops, 0, sizeof(loops));
+
+    struct repeat_state{
+        bool valid;
+        uint64_t tick;   // tick and steps when the iteration started
+        uint64_t steps;
+        uint32_t stack[MAX_STACK];
+        uint8_t pos;
+    }repeats[MAX_REPEAT];
+    uint16_t count[MAX_REPEAT];
+    uint64_t started[MAX_REPEAT]; // tick the current iteration started
+    uint8_t depth = 0;
+
+    struct{
+        const token_t* tokens;
+        size_t len;
+        size_t current;
+    }calls[MAX_CALLS];
+    uint8_t calls_depth = 0;
+
+    uint32_t stack[MAX_STACK] = {0};
+    uint8_t pos = 0;
+
+    uint64_t tick = 1;  // the ticks are counted from 1, like __call__
+    uint64_t steps = 0; // tokens executed in the current tick
+    size_t current = 0;
+
+    info->result = PATTERN_UNKNOWN;
+    info->duration = 0;
+    info->max_steps = 0;
+
+    for(uint32_t n = 0; n < ANALYZE_MAX_STEPS; n++){
+        const token_t* p = &tokens[current];
+        if(++steps > info->max_steps)
+            info->max_steps = steps;
+
+        switch(p->type){
+        case pSLEEP:{
+            uint32_t ticks = sleep_ticks(p, mhz);
+            if(!ticks){ // never wakes up again
+                info->result = PATTERN_INFINITE;
+                return;
+            }
+            tick = add_saturate(tick, ticks);
+            steps = 1;
+            break;
+        }
+
+        case pFOREVER:
+            info->result = PATTERN_INFINITE;
+            return;
+
+        case pINCREMENT:
+        case pDECREMENT:
+            stack[pos] += (p->type == pINCREMENT) ? 1 : -1;
+            loops[pos].delta += (p->type == pINCREMENT) ? 1 : -1;
+            break;
+
+        case pPUSH:
+            if(++pos == MAX_STACK){ // stack overflow
+                info->result = PATTERN_FINITE;
+                info->duration = tick;
+                return;
+            }
+            stack[pos] = p->push.value;
+            loops[pos].valid = false;
+            break;
+
+        case pPOP:
+            if(!pos){ // stack underflow
+                info->result = PATTERN_FINITE;
+                info->duration = tick;
+                return;
+            }
+            loops[pos--].valid = false;
+            break;
+
+        case pJUMP_NZERO:
+            if(!stack[pos]){
+                loops[pos].valid = false;
+                break;
+            }
+
+            // the jump yields the tick
+            tick = add_saturate(tick, 1);
+            steps = 0;
+
+            if(loops[pos].valid && (loops[pos].jump == p)){
+                // skip the iterations that still end with a jump
+                uint64_t i = loop_iterations(stack[pos], loops[pos].delta);
+                if(!i){ // the counter never becomes 0
+                    info->result = PATTERN_INFINITE;
+                    return;
+                }
+                tick = add_saturate(tick, mul_saturate(tick - loops[pos].start, i - 1));
+                stack[pos] += (uint32_t)(i - 1) * (uint32_t)loops[pos].delta;
+            }
+
+            loops[pos].valid = true;
+            loops[pos].jump  = p;
+            loops[pos].delta = 0;
+            loops[pos].start = tick;
+
+            current = p->jump.new_pp;
+            continue;
+
+        case pREPEAT:
+            count[depth] = p->repeat.count;
+            started[depth] = tick;
+            repeats[depth++].valid = false;
+            break;
+
+        case pREPEAT_END:{
+            if(!--count[depth - 1]){
+                depth--;
+                break;
+            }
+
+            if(started[depth - 1] == tick){ // no delay in the iteration, the jump yields
+                tick = add_saturate(tick, 1);
+                steps = 0;
+            }
+
+            struct repeat_state* r = &repeats[depth - 1];
+            if(r->valid && (r->pos == pos) && (r->steps == steps) &&
+               !memcmp(r->stack, stack, sizeof(stack[0]) * (pos + 1))){
+                // all remaining iterations are the same, only the last one is simulated
+                tick = add_saturate(tick, mul_saturate(tick - r->tick, count[depth - 1] - 1));
+                count[depth - 1] = 1;
+            }
+            started[depth - 1] = tick;
+
+            r->valid = true;
+            r->tick  = tick;
+            r->steps = steps;
+            r->pos   = pos;
+            memcpy(r->stack, stack, sizeof(stack));
+
+            current = p->jump.new_pp;
+            continue;
+        }
+
+        case pCALL:
+            calls[calls_depth].tokens  = tokens;
+            calls[calls_depth].len     = len;
+            calls[calls_depth].current = current;
+            calls_depth++;
+            tokens  = p->call.tokens;
+            len     = p->call.len;
+            current = 0;
+            continue;
+
+        case pRETURN:
+            calls_depth--;
+            tokens  = calls[calls_depth].tokens;
+            len     = calls[calls_depth].len;
+            current = calls[calls_depth].current;
+            break;
+
+        default:
+            break;
+        }
+
+        if(++current == len){
+            info->result = PATTERN_FINITE;
+            info->duration = tick;
+            return;
+        }
+    }
+}
+
+
+/**
+ * called from the transfer complete interrupt,
+ * the data is in the shift registers and can be latched
+ */
+static void transfer_done(void* arg){
+    tlc5947_tlc5947_obj_t* self = arg;
+    mp_hal_pin_high(self->xlat);
+}
+
+static void write_buffer(tlc5947_tlc5947_obj_t* self, const uint8_t* buf){
+    mp_hal_pin_low(self->xlat);
+    if(!transfer_start(&self->transfer, buf, 36 * self->len)){
+        // no DMA available, fall back to the blocking transfer
+        ((mp_machine_spi_p_t *)MP_OBJ_TYPE_GET_SLOT(self->spi->type, protocol))->transfer(self->spi, 36 * self->len, buf, NULL);
+        mp_hal_pin_high(self->xlat);
+    }
+}
+
+/**
+ * swaps the front and back buffer and transmits the new front buffer,
+ * afterwards the back buffer is synced so it always holds the latest
+ * complete frame, and the next frame can be assembled incrementally.
+ */
+static void write_back_buffer(tlc5947_tlc5947_obj_t* self){
+    uint8_t* tmp = self->front;
+    self->front  = self->back;
+    self->back   = tmp;
+
+    write_buffer(self, self->front);
+
+    memcpy(self->back, self->front, 36 * self->len);
+}
+
+/**
+ * returns the data of the RAW frame, NULL if there is none.
+ * Only the object is stored, the buffer may have moved since
+ * write_frame() if it was resized.
+ */
+static const uint8_t* get_raw_frame(tlc5947_tlc5947_obj_t* self){
+    mp_buffer_info_t bufinfo;
+    if((self->frame.raw == MP_OBJ_NULL) ||
+       !mp_get_buffer(self->frame.raw, &bufinfo, MP_BUFFER_READ) ||
+       (bufinfo.len != (36 * self->len)))
+        return NULL;
+    return bufinfo.buf;
+}
+
+/**
+ * transmits the next frame, if there is a new one
+ */
+static void send_frame(tlc5947_tlc5947_obj_t* self){
+    if(self->frame.active){
+        if(self->frame.pending){
+            if(self->frame.raw != MP_OBJ_NULL){
+                // a RAW frame that changed its size is dropped
+                const uint8_t* buf = get_raw_frame(self);
+                if(buf){
+                    self->frame.sent = self->frame.raw;
+                    write_buffer(self, buf);
+                }
+            }else{
+                self->frame.sent = MP_OBJ_NULL; // send_frame() is only called when no transfer is busy
+                write_back_buffer(self);
+            }
+            self->frame.pending = false;
+        }
+    }else if(self->data.changed || self->dither.error){
+        // with dithering every frame differs from the previous one
+        update_buffer(self);
+        write_back_buffer(self);
+        self->data.changed = false;
+    }
 }
 
 
@@ -875,37 +2174,90 @@ mp_obj_t tlc5947_tlc5947_make_new(const mp_obj_type_t *type, size_t n_args,
 static void tlc5947_tlc5947_print(const mp_print_t *print,
                                   mp_obj_t self_in, mp_print_kind_t kind);
 static void* tlc5947_tlc5947_call(void* self_in, size_t _0, size_t _1, void* const* _2);
+static mp_obj_t tlc5947_tlc5947_write_frame(size_t n_args, const mp_obj_t *args);
 static mp_obj_t tlc5947_tlc5947_blank(mp_obj_t self_in, mp_obj_t val);
-static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t pattern_in);
-static mp_obj_t tlc5947_tlc5947_replace(mp_obj_t self_in, mp_obj_t pid_in, mp_obj_t pattern_in);
+static mp_obj_t tlc5947_tlc5947_set(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args);
+static mp_obj_t tlc5947_tlc5947_replace(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args);
 static mp_obj_t tlc5947_tlc5947_get(mp_obj_t self_in, mp_obj_t led_in);
 static mp_obj_t tlc5947_tlc5947_exists(mp_obj_t self_in, mp_obj_t pid_in);
 static mp_obj_t tlc5947_tlc5947_delete(mp_obj_t self_in, mp_obj_t pattern_in);
+static mp_obj_t tlc5947_tlc5947_blend(size_t n_args, const mp_obj_t *args);
 static mp_obj_t tlc5947_tlc5947_set_white_balance(mp_obj_t self_in, mp_obj_t matrix_in);
 static mp_obj_t tlc5947_tlc5947_set_gamut(mp_obj_t self_in, mp_obj_t matrix_in);
+static mp_obj_t tlc5947_tlc5947_set_profile(size_t n_args, const mp_obj_t *args);
+static mp_obj_t tlc5947_tlc5947_assign_profile(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t profile_in);
+static mp_obj_t tlc5947_tlc5947_master(size_t n_args, const mp_obj_t *args);
+static mp_obj_t tlc5947_tlc5947_dither(size_t n_args, const mp_obj_t *args);
+static mp_obj_t tlc5947_tlc5947_power_limit(size_t n_args, const mp_obj_t *args);
+static mp_obj_t tlc5947_tlc5947_curve(mp_obj_t self_in, mp_obj_t curve_in);
+static mp_obj_t tlc5947_tlc5947_freq(size_t n_args, const mp_obj_t *args);
+static mp_obj_t tlc5947_tlc5947_define(mp_obj_t self_in, mp_obj_t name_in, mp_obj_t pattern_in);
 static mp_obj_t tlc5947_tlc5947_set_id_map(mp_obj_t self_in, mp_obj_t map_in);
+static mp_obj_t tlc5947_tlc5947_set_matrix(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args);
 
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_write_frame_obj, 2, 3, tlc5947_tlc5947_write_frame);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_blank_obj, tlc5947_tlc5947_blank);
-static MP_DEFINE_CONST_FUN_OBJ_3(tlc5947_tlc5947_set_obj, tlc5947_tlc5947_set);
-static MP_DEFINE_CONST_FUN_OBJ_3(tlc5947_tlc5947_replace_obj, tlc5947_tlc5947_replace);
+static MP_DEFINE_CONST_FUN_OBJ_KW(tlc5947_tlc5947_set_obj, 3, tlc5947_tlc5947_set);
+static MP_DEFINE_CONST_FUN_OBJ_KW(tlc5947_tlc5947_replace_obj, 3, tlc5947_tlc5947_replace);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_get_obj, tlc5947_tlc5947_get);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_exists_obj, tlc5947_tlc5947_exists);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_delete_obj, tlc5947_tlc5947_delete);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_blend_obj, 3, 4, tlc5947_tlc5947_blend);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_set_white_balance_obj,tlc5947_tlc5947_set_white_balance);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_set_gamut_obj,tlc5947_tlc5947_set_gamut);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_set_profile_obj, 3, 4, tlc5947_tlc5947_set_profile);
+static MP_DEFINE_CONST_FUN_OBJ_3(tlc5947_tlc5947_assign_profile_obj, tlc5947_tlc5947_assign_profile);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_master_obj, 1, 2, tlc5947_tlc5947_master);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_dither_obj, 1, 2, tlc5947_tlc5947_dither);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_power_limit_obj, 2, 3, tlc5947_tlc5947_power_limit);
+static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_curve_obj, tlc5947_tlc5947_curve);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(tlc5947_tlc5947_freq_obj, 1, 2, tlc5947_tlc5947_freq);
+static MP_DEFINE_CONST_FUN_OBJ_3(tlc5947_tlc5947_define_obj, tlc5947_tlc5947_define);
 static MP_DEFINE_CONST_FUN_OBJ_2(tlc5947_tlc5947_set_id_map_obj,tlc5947_tlc5947_set_id_map);
+static MP_DEFINE_CONST_FUN_OBJ_KW(tlc5947_tlc5947_set_matrix_obj, 3, tlc5947_tlc5947_set_matrix);
 
 static const mp_rom_map_elem_t tlc5947_tlc5947_locals_dict_table[] = {
     // class methods
+    { MP_ROM_QSTR(MP_QSTR_write_frame),       MP_ROM_PTR(&tlc5947_tlc5947_write_frame_obj)       },
     { MP_ROM_QSTR(MP_QSTR_blank),             MP_ROM_PTR(&tlc5947_tlc5947_blank_obj)             },
     { MP_ROM_QSTR(MP_QSTR_set),               MP_ROM_PTR(&tlc5947_tlc5947_set_obj)               },
     { MP_ROM_QSTR(MP_QSTR_replace),           MP_ROM_PTR(&tlc5947_tlc5947_replace_obj)           },
     { MP_ROM_QSTR(MP_QSTR_get),               MP_ROM_PTR(&tlc5947_tlc5947_get_obj)               },
     { MP_ROM_QSTR(MP_QSTR_exists),            MP_ROM_PTR(&tlc5947_tlc5947_exists_obj)            },
     { MP_ROM_QSTR(MP_QSTR_delete),            MP_ROM_PTR(&tlc5947_tlc5947_delete_obj)            },
+    { MP_ROM_QSTR(MP_QSTR_blend),             MP_ROM_PTR(&tlc5947_tlc5947_blend_obj)             },
     { MP_ROM_QSTR(MP_QSTR_set_white_balance), MP_ROM_PTR(&tlc5947_tlc5947_set_white_balance_obj) },
     { MP_ROM_QSTR(MP_QSTR_set_gamut),         MP_ROM_PTR(&tlc5947_tlc5947_set_gamut_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_set_profile),       MP_ROM_PTR(&tlc5947_tlc5947_set_profile_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_assign_profile),    MP_ROM_PTR(&tlc5947_tlc5947_assign_profile_obj)    },
+    { MP_ROM_QSTR(MP_QSTR_master),            MP_ROM_PTR(&tlc5947_tlc5947_master_obj)            },
+    { MP_ROM_QSTR(MP_QSTR_dither),            MP_ROM_PTR(&tlc5947_tlc5947_dither_obj)            },
+    { MP_ROM_QSTR(MP_QSTR_power_limit),       MP_ROM_PTR(&tlc5947_tlc5947_power_limit_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_curve),             MP_ROM_PTR(&tlc5947_tlc5947_curve_obj)             },
+    { MP_ROM_QSTR(MP_QSTR_freq),              MP_ROM_PTR(&tlc5947_tlc5947_freq_obj)              },
+    { MP_ROM_QSTR(MP_QSTR_define),            MP_ROM_PTR(&tlc5947_tlc5947_define_obj)            },
     { MP_ROM_QSTR(MP_QSTR_set_id_map),        MP_ROM_PTR(&tlc5947_tlc5947_set_id_map_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_set_matrix),        MP_ROM_PTR(&tlc5947_tlc5947_set_matrix_obj)        },
+
+    // class constants
+    { MP_ROM_QSTR(MP_QSTR_TOP_LEFT),          MP_ROM_INT(0)                                      },
+    { MP_ROM_QSTR(MP_QSTR_TOP_RIGHT),         MP_ROM_INT(1)                                      },
+    { MP_ROM_QSTR(MP_QSTR_BOTTOM_LEFT),       MP_ROM_INT(2)                                      },
+    { MP_ROM_QSTR(MP_QSTR_BOTTOM_RIGHT),      MP_ROM_INT(3)                                      },
+    { MP_ROM_QSTR(MP_QSTR_RGB8),              MP_ROM_INT(FRAME_RGB8)                             },
+    { MP_ROM_QSTR(MP_QSTR_RGB12),             MP_ROM_INT(FRAME_RGB12)                            },
+    { MP_ROM_QSTR(MP_QSTR_RAW),               MP_ROM_INT(FRAME_RAW)                              },
+    { MP_ROM_QSTR(MP_QSTR_PROFILES),          MP_ROM_INT(TLC5947_PROFILES)                       },
+    { MP_ROM_QSTR(MP_QSTR_LOG),               MP_ROM_INT(CURVE_LOG)                              },
+    { MP_ROM_QSTR(MP_QSTR_LINEAR),            MP_ROM_INT(CURVE_LINEAR)                           },
+    { MP_ROM_QSTR(MP_QSTR_CIE1931),           MP_ROM_INT(CURVE_CIE1931)                          },
+    { MP_ROM_QSTR(MP_QSTR_GAMMA22),           MP_ROM_INT(CURVE_GAMMA22)                          },
+    { MP_ROM_QSTR(MP_QSTR_GAMMA28),           MP_ROM_INT(CURVE_GAMMA28)                          },
+    { MP_ROM_QSTR(MP_QSTR_NORMAL),            MP_ROM_INT(BLEND_NORMAL)                           },
+    { MP_ROM_QSTR(MP_QSTR_ALPHA),             MP_ROM_INT(BLEND_ALPHA)                            },
+    { MP_ROM_QSTR(MP_QSTR_ADD),               MP_ROM_INT(BLEND_ADD)                              },
+    { MP_ROM_QSTR(MP_QSTR_MULTIPLY),          MP_ROM_INT(BLEND_MULTIPLY)                         },
+    { MP_ROM_QSTR(MP_QSTR_MAX),               MP_ROM_INT(BLEND_MAX)                              },
 };
 static MP_DEFINE_CONST_DICT(tlc5947_tlc5947_locals_dict,tlc5947_tlc5947_locals_dict_table);
 
@@ -922,29 +2274,68 @@ MP_DEFINE_CONST_OBJ_TYPE(
 
 
 /**
- * Python: tlc5947.tlc5947(spi, xlat, blank)
+ * Python: tlc5947.tlc5947(spi, xlat, blank, length=1)
  * @param spi
  * @param xlat
  * @param blank
+ * @param length number of chained tlc5947 devices
  */
 mp_obj_t tlc5947_tlc5947_make_new(const mp_obj_type_t *type,
                                   size_t n_args,
                                   size_t n_kw,
                                   const mp_obj_t *args){
-    mp_arg_check_num(n_args, n_kw, 3, 3, true);
+    mp_arg_check_num(n_args, n_kw, 3, 4, true);
+
+    int len = 1;
+    if(n_args == 4)
+        len = mp_obj_get_int(args[3]);
+    if((len <= 0) || (len > (0xFFFF / 8)))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid length"));
 
     tlc5947_tlc5947_obj_t *self = mp_obj_malloc(tlc5947_tlc5947_obj_t, type);
 
     self->spi   = mp_hal_get_spi_obj(args[0]);
     self->xlat  = mp_hal_get_pin_obj(args[1]);
     self->blank = mp_hal_get_pin_obj(args[2]);
-
-    memset(self->buffer, 0, 36);
+    transfer_init(&self->transfer, args[0], transfer_done, self);
+
+    self->len  = len;
+    self->leds = len * 8;
+
+    self->front = m_malloc(2 * 36 * self->len);
+    self->back  = self->front + 36 * self->len;
+    self->id_map = m_malloc(sizeof(uint16_t) * self->leds);
+    memset(self->front, 0, 2 * 36 * self->len);
+    memset(&self->matrix, 0, sizeof(self->matrix));
+    memset(&self->frame, 0, sizeof(self->frame));
+    memset(&self->subroutines, 0, sizeof(self->subroutines));
     memset(&self->data, 0, sizeof(self->data));
+    self->blanked = false;
+    self->data.pattern_map = m_malloc(sizeof(*self->data.pattern_map) * self->leds);
+    memset(self->data.pattern_map, 0, sizeof(*self->data.pattern_map) * self->leds);
+    self->data.colors = m_malloc(sizeof(rgb16) * self->leds);
+    memset(self->data.colors, 0, sizeof(rgb16) * self->leds);
+    self->profile = m_malloc(self->leds);
+    memset(self->profile, 0, self->leds);
+    self->master.level  = 4095;
+    self->master.lut    = NULL;
+    self->master.tables = NULL;
+    self->data.output = m_malloc(sizeof(rgb16) * self->leds);
+    memset(self->data.output, 0, sizeof(rgb16) * self->leds);
+    self->dither.error  = NULL;
+    self->power.budget = 0;
+    self->power.load   = 0;
+    self->power.scale  = 65536;
+    self->power.leds   = m_malloc(sizeof(uint16_t) * self->leds);
+    memset(self->power.leds, 0, sizeof(uint16_t) * self->leds);
+    self->curve      = brightness_curve(CURVE_LOG);
+    self->user_curve = NULL;
+    self->freq.mhz = TLC5947_FREQ_MHZ;
     self->data.changed = true; // make sure all leds are set to BLACK on startup
+    self->data.recalibrate = true;
 
     // setup the default id_map
-    for(uint16_t i = 0; i < 8; i++)
+    for(uint16_t i = 0; i < self->leds; i++)
         self->id_map[i] = i;
 
     // setup the default white balance
@@ -953,6 +2344,10 @@ mp_obj_t tlc5947_tlc5947_make_new(const mp_obj_type_t *type,
     // setup the default gamut
     default_gamut_matrix(self->gamut_m);
 
+    // all profiles start out uncalibrated
+    for(uint8_t i = 0; i < TLC5947_PROFILES; i++)
+        color_matrix_set(self->profiles[i], self->white_m, self->gamut_m);
+
     return MP_OBJ_FROM_PTR(self);
 }
 
@@ -964,7 +2359,7 @@ static void tlc5947_tlc5947_print(const mp_print_t *print,
                                   mp_obj_t self_in,mp_print_kind_t kind){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
     mp_printf(print, "tlc5947(xlat=" MP_HAL_PIN_FMT ", blank=" MP_HAL_PIN_FMT ", length=%d)",
-              self->xlat, self->blank);
+              self->xlat, self->blank, self->len);
 }
 
 /**
@@ -974,56 +2369,315 @@ static void tlc5947_tlc5947_print(const mp_print_t *print,
 static void* tlc5947_tlc5947_call(void* self_in, size_t _0, size_t _1, void* const* _2){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
     if(IS_UNLOCKED(self)){
-        if(do_tick(self)){
-            mp_hal_pin_low(self->xlat);
-            ((mp_machine_spi_p_t *)MP_OBJ_TYPE_GET_SLOT(self->spi->type, protocol))->transfer(self->spi, 36, self->buffer, NULL);
-            mp_hal_pin_high(self->xlat);
-            self->data.changed = false;
-        }
+        // in streaming mode the patterns are not advanced
+        if(!self->frame.active)
+            do_tick(self);
+
+        /**
+         * While BLANK is asserted nothing is encoded or transmitted, the
+         * changes accumulate and are flushed as a single frame by blank(False).
+         * While the previous frame is still being shifted out, the patterns
+         * keep advancing, the new frame is sent on the next tick.
+         */
+        if(!self->blanked && !self->transfer.busy)
+            send_frame(self);
     }
     return mp_const_none;
 }
 
-/**
- * Python: tlc5947.tlc5947.blank(self, val)
- * @param self
- * @param val
+static rgb12 get_frame_color(const uint8_t* buf, int format){
+    rgb12 c;
+    if(format == FRAME_RGB8){
+        rgb8 c8 = {.r = buf[0], .g = buf[1], .b = buf[2]};
+        c = rgb8torgb12(c8);
+    }else{
+        c.r = buf[0] | (buf[1] << 8);
+        c.g = buf[2] | (buf[3] << 8);
+        c.b = buf[4] | (buf[5] << 8);
+    }
+    return c;
+}
+
+/**
+ * Python: tlc5947.tlc5947.write_frame(self, buf, format=RGB8)
+ * @param self
+ * @param buf    any object supporting the buffer protocol, or None to leave streaming mode
+ * @param format RGB8, RGB12 or RAW
+ */
+static mp_obj_t tlc5947_tlc5947_write_frame(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if(args[1] == mp_const_none){
+        // leave streaming mode, the patterns take over again
+        LOCK(self);
+        // the last RAW frame may still be transmitted
+        while(self->transfer.busy);
+        memset(&self->frame, 0, sizeof(self->frame));
+        // the cached colors are the ones of the last streamed frame
+        recalibrate(self);
+        UNLOCK(self);
+        return mp_const_none;
+    }
+
+    int format = FRAME_RGB8;
+    if(n_args == 3)
+        format = mp_obj_get_int(args[2]);
+
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_READ);
+    const uint8_t* buf = bufinfo.buf;
+
+    size_t frame_leds = get_frame_leds(self);
+
+    switch(format){
+    case FRAME_RGB8:
+    case FRAME_RGB12:{
+        size_t bpl = (format == FRAME_RGB8) ? 3 : 6; // bytes per led
+        if(bufinfo.len != (frame_leds * bpl))
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid frame size"));
+
+        // the power limit also applies to streamed frames
+        uint32_t load = 0;
+        for(size_t i = 0; i < frame_leds; i++)
+            load += color_load(rgb12torgb16(get_frame_color(buf + i * bpl, format)));
+        uint32_t scale = power_scale(self, load);
+
+        LOCK(self);
+        for(size_t i = 0; i < frame_leds; i++, buf += bpl){
+            uint16_t led;
+            if(!get_led_from_frame(self, i, &led))
+                continue;
+
+            rgb12 c = get_frame_color(buf, format);
+            if(scale != 65536)
+                c = rgb16torgb12(scale_color(rgb12torgb16(c), scale));
+            set_buffer(self->back + get_device_offset(self, led), led % 8, c);
+        }
+        self->frame.raw = MP_OBJ_NULL;
+        break;
+    }
+
+    case FRAME_RAW:
+        if(bufinfo.len != (36 * self->len))
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid frame size"));
+
+        // the object is kept instead of the pointer, so it is not collected
+        LOCK(self);
+        self->frame.raw = args[1];
+        break;
+
+    default:
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid frame format"));
+    }
+
+    self->frame.active  = true;
+    self->frame.pending = true;
+    UNLOCK(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.blank(self, val)
+ * @param self
+ * @param val
  */
 static mp_obj_t tlc5947_tlc5947_blank(mp_obj_t self_in, mp_obj_t val){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    mp_hal_pin_write(self->blank, mp_obj_is_true(val));
+    LOCK(self);
+
+    if(mp_obj_is_true(val)){
+        mp_hal_pin_write(self->blank, 1);
+        self->blanked = true;
+    }else{
+        if(self->blanked){
+            /**
+             * flush the frame that was suppressed while blanked,
+             * it has to be latched before the outputs are enabled again
+             */
+            while(self->transfer.busy);
+            send_frame(self);
+            while(self->transfer.busy);
+            self->blanked = false;
+        }
+        mp_hal_pin_write(self->blank, 0);
+    }
+
+    UNLOCK(self);
 
     return mp_const_none;
 }
 
 /**
- * Python: tlc5947.tlc5947.set(self, led, pattern)
+ * sets the operand of a placeholder token to value,
+ * returns false if the value has the wrong type or is out of range
+ */
+static bool patch_token(token_t* t, mp_obj_t value){
+    mp_int_t i;
+    mp_float_t f;
+
+    switch(t->type){
+    case pCOLOR:
+        if(!mp_obj_get_int_maybe(value, &i) || (i < 0) || (i > 0xFFFFFF))
+            return false;
+        t->color.color = rgb8torgb12((rgb8){.r = i >> 16, .g = (i >> 8) & 0xFF, .b = i & 0xFF});
+        return true;
+
+    case pHUE:
+        if(!mp_obj_get_float_maybe(value, &f))
+            return false;
+        t->hue.hue = hue_value(f);
+        return true;
+
+    case pKELVIN:
+        if(!mp_obj_get_int_maybe(value, &i))
+            return false;
+        t->kelvin.kelvin = (i < KELVIN_MIN) ? KELVIN_MIN : ((i > KELVIN_MAX) ? KELVIN_MAX : i);
+        return true;
+
+    case pBRIGHTNESS:
+        if(!mp_obj_get_float_maybe(value, &f))
+            return false;
+        t->brightness.brightness = brightness_value(f);
+        return true;
+
+    case pSLEEP:
+        if(!mp_obj_get_int_maybe(value, &i) || (i < 0) || ((uint64_t)i > UINT32_MAX))
+            return false;
+        t->sleep.sleep_time = i;
+        return true;
+
+    case pPUSH:
+        if(!mp_obj_get_int_maybe(value, &i) || (i < 0) || ((uint64_t)i > UINT32_MAX))
+            return false;
+        t->push.value = i;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * fills the placeholders of the tokens with the keyword arguments,
+ * on an error the tokens (and the slots if free_slots is set) are freed
+ */
+static void patch_template(token_t* tokens, template_slot_t* slots, size_t slots_len, mp_map_t* kw_args, bool free_slots){
+    const mp_obj_type_t* type = &mp_type_TypeError;
+    mp_rom_error_text_t msg = NULL;
+
+    for(size_t i = 0; i < slots_len; i++){
+        mp_map_elem_t* arg = mp_map_lookup(kw_args, MP_OBJ_NEW_QSTR(slots[i].name), MP_MAP_LOOKUP);
+        if(!arg){
+            msg = MP_ERROR_TEXT("missing template argument");
+            break;
+        }
+        if(!patch_token(&tokens[slots[i].pos], arg->value)){
+            type = &mp_type_ValueError;
+            msg = MP_ERROR_TEXT("invalid template argument");
+            break;
+        }
+    }
+
+    // every keyword argument has to fill a placeholder
+    for(size_t i = 0; !msg && (i < kw_args->alloc); i++){
+        if(!mp_map_slot_is_filled(kw_args, i))
+            continue;
+        qstr name = mp_obj_str_get_qstr(kw_args->table[i].key);
+        size_t j = 0;
+        while((j < slots_len) && (slots[j].name != name))
+            j++;
+        if(j == slots_len)
+            msg = MP_ERROR_TEXT("unknown template argument");
+    }
+
+    if(free_slots)
+        m_free(slots);
+
+    if(msg){
+        m_free(tokens);
+        mp_raise_msg(type, msg);
+    }
+}
+
+/**
+ * get the tokens of a pattern, either by compiling a string or from a Program,
+ * the placeholders are filled with the keyword arguments
  * @param self
- * @param led
- * @param pattern
+ * @param pattern_in pattern string or Program
+ * @param kw_args values of the placeholders
+ * @param len number of tokens
+ * @param shared set if the tokens belong to a Program
  */
-static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t pattern_in){
-    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
+static token_t* get_pattern_tokens(tlc5947_tlc5947_obj_t* self, mp_obj_t pattern_in, mp_map_t* kw_args,
+                                   size_t* len, bool* shared){
+    if(mp_obj_is_type(pattern_in, &tlc5947_program_type)){
+        tlc5947_program_obj_t* program = MP_OBJ_TO_PTR(pattern_in);
+        *len = program->len;
+        if(!program->slots.len && !kw_args->used){
+            *shared = true;
+            return program->tokens;
+        }
+
+        // a template, only the operands of the copy are patched
+        token_t* tokens = m_malloc(sizeof(token_t) * program->len);
+        memcpy(tokens, program->tokens, sizeof(token_t) * program->len);
+        *shared = false;
+        patch_template(tokens, program->slots.list, program->slots.len, kw_args, false);
+        return tokens;
+    }
 
-    // lex the current pattern, and add it to the pattern_list
-    const char* pattern_str = mp_obj_str_get_str(pattern_in);
+    template_slot_t* slots;
+    size_t slots_len;
+    token_t* tokens = compile_pattern(self, mp_obj_str_get_str(pattern_in), len, NULL, &slots, &slots_len);
+    *shared = false;
+    patch_template(tokens, slots, slots_len, kw_args, true);
+    return tokens;
+}
+
+/**
+ * Python: tlc5947.tlc5947.set(self, led, pattern, **placeholders)
+ * @param self
+ * @param led
+ * @param pattern pattern string or Program
+ * @param placeholders values of the placeholders of a template
+ */
+static mp_obj_t tlc5947_tlc5947_set(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args){
+    mp_arg_check_num(n_args, 0, 3, 3, true);
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t led_in = args[1];
 
-    check_pattern_string(pattern_str);
+    // compile the current pattern, and add it to the pattern_list
+    size_t pl;
+    bool shared;
+    token_t* tokens = get_pattern_tokens(self, args[2], kw_args, &pl, &shared);
 
-    size_t pl = get_pattern_length(pattern_str);
+    // resolve all led's before the pattern is created, so nothing has to be undone
+    size_t len;
+    uint16_t* leds = get_leds(self, led_in, &len);
 
     /**
      * Lock the tlc5947_object, because if realloc succeeds the original pattern list becomes invalid
      * this makes sure the pattern list is not used by __call__
      */
+    if(self->data.patterns.len == 0xFFFF){
+        m_free(leds);
+        if(!shared)
+            m_free(tokens);
+        mp_raise_ValueError(MP_ERROR_TEXT("too many patterns"));
+    }
+
     LOCK(self);
 
     void* new_plist = m_realloc_maybe(self->data.patterns.list,
                                       sizeof(pattern_base_t) * (self->data.patterns.len+1), true);
     if(!new_plist){
         UNLOCK(self);
-        m_malloc_fail(sizeof(token_t) * (self->data.patterns.len+1));
+        m_free(leds);
+        if(!shared)
+            m_free(tokens);
+        m_malloc_fail(sizeof(pattern_base_t) * (self->data.patterns.len+1));
     }
     self->data.patterns.list = new_plist;
 
@@ -1032,17 +2686,14 @@ static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t
 
     memset(&self->data.patterns.list[self->data.patterns.len], 0, sizeof(pattern_base_t));
 
-    self->data.patterns.list[self->data.patterns.len].tokens  = m_malloc_maybe(sizeof(token_t) * pl);
+    self->data.patterns.list[self->data.patterns.len].tokens  = tokens;
     self->data.patterns.list[self->data.patterns.len].id      = pid;
     self->data.patterns.list[self->data.patterns.len].len     = pl;
+    self->data.patterns.list[self->data.patterns.len].shared  = shared;
     self->data.patterns.list[self->data.patterns.len].visible = true;
+    self->data.patterns.list[self->data.patterns.len].brightness = 65536;
+    self->data.patterns.list[self->data.patterns.len].alpha = 4096;
 
-    if(!self->data.patterns.list[self->data.patterns.len].tokens){
-        UNLOCK(self);
-        m_malloc_fail(sizeof(token_t) * pl);
-    }
-
-    tokenize_pattern_str(pattern_str, self->data.patterns.list[self->data.patterns.len].tokens, pl);
 
     self->data.patterns.len++;
 
@@ -1052,16 +2703,13 @@ static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t
     UNLOCK(self);
 
     // now put this new pattern into the pattern_map
-    if(mp_obj_is_int(led_in)){
-        int tmpled;
-        if(!mp_obj_get_int_maybe(led_in, &tmpled)){
-            delete_pattern(self, pid);
-            mp_raise_TypeError(MP_ERROR_TEXT("expected int"));
-        }
-        uint8_t led;
-        if(!get_led_from_id_map(self, mp_obj_get_int(led_in), &led)){
+    for(size_t i = 0; i < len; i++){
+        uint16_t led = leds[i];
+
+        if(self->data.pattern_map[led].len == 0xFFFF){
             delete_pattern(self, pid);
-            mp_raise_ValueError(MP_ERROR_TEXT("led not in id_map"));
+            m_free(leds);
+            mp_raise_ValueError(MP_ERROR_TEXT("too many patterns"));
         }
 
         LOCK(self);
@@ -1071,6 +2719,7 @@ static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t
         if(!new_map){// realloc failed, delete pattern
             UNLOCK(self);
             delete_pattern(self, pid);
+            m_free(leds);
             m_malloc_fail(sizeof(uint16_t) * (self->data.pattern_map[led].len + 1));
         }
         self->data.pattern_map[led].map = new_map;
@@ -1079,50 +2728,8 @@ static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t
         self->data.pattern_map[led].len++;
 
         UNLOCK(self);
-
-    }else if(mp_obj_is_type(led_in, &mp_type_list)){
-        mp_obj_t* list;
-        size_t len;
-        mp_obj_get_array(led_in, &len, &list);
-        int* leds = m_malloc(len * sizeof(int));
-
-        for(size_t i = 0; i < len; i++){
-            if(!mp_obj_get_int_maybe(list[i], &leds[i])){
-                delete_pattern(self, pid);
-                m_free(leds);
-                mp_raise_TypeError(MP_ERROR_TEXT("expected list of int"));
-            }
-        }
-
-        for(size_t i = 0; i < len; i++){
-            uint8_t led;
-            if(!get_led_from_id_map(self, leds[i], &led)){
-                delete_pattern(self, pid);
-                m_free(leds);
-                mp_raise_TypeError(MP_ERROR_TEXT("led not in map"));
-            }
-
-            LOCK(self);
-
-            void* new_map = m_realloc_maybe(self->data.pattern_map[led].map,
-                                            sizeof(uint16_t) * (self->data.pattern_map[led].len + 1), true);
-            if(!new_map){// realloc failed, delete pattern
-                UNLOCK(self);
-                delete_pattern(self, pid);
-                m_malloc_fail(sizeof(uint16_t) * (self->data.pattern_map[led].len + 1));
-            }
-            self->data.pattern_map[led].map = new_map;
-
-            self->data.pattern_map[led].map[self->data.pattern_map[led].len] = pid;
-            self->data.pattern_map[led].len++;
-
-            UNLOCK(self);
-        }
-        m_free(leds);
-    }else{
-        delete_pattern(self, pid);
-        mp_raise_TypeError(MP_ERROR_TEXT("expected int or list of int"));
     }
+    m_free(leds);
 
     dump_pattern_map(self);
 
@@ -1130,21 +2737,17 @@ static mp_obj_t tlc5947_tlc5947_set(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t
 }
 
 /**
- * Python: tlc5947.tlc5947.replace(self, pid, pattern)
+ * Python: tlc5947.tlc5947.replace(self, pid, pattern, **placeholders)
  * @param self
  * @param pid
- * @param pattern
+ * @param pattern pattern string or Program
+ * @param placeholders values of the placeholders of a template
  */
-static mp_obj_t tlc5947_tlc5947_replace(mp_obj_t self_in, mp_obj_t pid_in, mp_obj_t pattern_in){
-    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
+static mp_obj_t tlc5947_tlc5947_replace(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args){
+    mp_arg_check_num(n_args, 0, 3, 3, true);
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
 
-    const char* pattern_str = mp_obj_str_get_str(pattern_in);
-
-    check_pattern_string(pattern_str);
-
-    size_t pl = get_pattern_length(pattern_str);
-
-    int pid = mp_obj_get_int(pid_in);
+    int pid = mp_obj_get_int(args[1]);
 
     int pos = -1;
     for(uint16_t i = 0; i < self->data.patterns.len; i++)
@@ -1156,24 +2759,22 @@ static mp_obj_t tlc5947_tlc5947_replace(mp_obj_t self_in, mp_obj_t pid_in, mp_ob
     if((pid <= 0) || (pos == -1))
         mp_raise_ValueError(MP_ERROR_TEXT("Invalid Pattern ID"));
 
-    token_t* new_tokens = m_malloc_maybe(sizeof(token_t) * pl);
-
-    if(!new_tokens){
-        m_malloc_fail(sizeof(token_t) * pl);
-    }
-
-    tokenize_pattern_str(pattern_str, new_tokens, pl);
+    size_t pl;
+    bool shared;
+    token_t* new_tokens = get_pattern_tokens(self, args[2], kw_args, &pl, &shared);
 
     LOCK(self);
 
-    if(self->data.patterns.list[pos].tokens != &fixed_forever_token)
-        m_free(self->data.patterns.list[pos].tokens);
+    free_tokens(&self->data.patterns.list[pos]);
     memset(&self->data.patterns.list[pos], 0, sizeof(pattern_base_t));
 
     self->data.patterns.list[pos].tokens  = new_tokens;
     self->data.patterns.list[pos].id      = pid;
     self->data.patterns.list[pos].len     = pl;
+    self->data.patterns.list[pos].shared  = shared;
     self->data.patterns.list[pos].visible = true;
+    self->data.patterns.list[pos].brightness = 65536;
+    self->data.patterns.list[pos].alpha = 4096;
 
     UNLOCK(self);
 
@@ -1187,12 +2788,12 @@ static mp_obj_t tlc5947_tlc5947_replace(mp_obj_t self_in, mp_obj_t pid_in, mp_ob
  */
 static mp_obj_t tlc5947_tlc5947_get(mp_obj_t self_in, mp_obj_t led_in){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    uint8_t led;
-    if(!get_led_from_id_map(self, mp_obj_get_int(led_in), &led)){
-        mp_raise_ValueError(MP_ERROR_TEXT("led not in map"));
-    }
+    uint16_t led = get_led(self, led_in);
 
-    rgb8 c = rgb12torgb8(get_buffer(self->buffer, led));
+    const uint8_t* buf = get_raw_frame(self);
+    if(!buf)
+        buf = self->front;
+    rgb8 c = rgb12torgb8(get_buffer(buf + get_device_offset(self, led), led % 8));
 
     char* str = m_malloc(8);
 
@@ -1236,6 +2837,49 @@ static mp_obj_t tlc5947_tlc5947_delete(mp_obj_t self_in, mp_obj_t pid_in){
     return mp_obj_new_bool(delete_pattern(self, pid));
 }
 
+/**
+ * Python: tlc5947.tlc5947.blend(self, pattern_id, mode, alpha=1)
+ * @param self
+ * @param pattern_id
+ * @param mode  NORMAL, ALPHA, ADD, MULTIPLY or MAX
+ * @param alpha opacity 0 -> 1
+ */
+static mp_obj_t tlc5947_tlc5947_blend(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    int pid  = mp_obj_get_int(args[1]);
+    int mode = mp_obj_get_int(args[2]);
+    if((mode < BLEND_NORMAL) || (mode > BLEND_MAX))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid blend mode"));
+
+    uint16_t alpha = 4096;
+    if(n_args == 4){
+        mp_float_t f;
+        if(!mp_obj_get_float_maybe(args[3], &f))
+            mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+        alpha = (uint16_t)(clamp(((float)f), 0.0F, 1.0F) * 4096.0F + 0.5F);
+    }
+
+    // a fully opaque alpha blend is the same as normal, and ends the stack walk early
+    if((mode == BLEND_ALPHA) && (alpha == 4096))
+        mode = BLEND_NORMAL;
+
+    if(pid <= 0)
+        return mp_const_false;
+
+    pattern_base_t* pattern = find_pattern(self, pid);
+    if(!pattern)
+        return mp_const_false;
+
+    LOCK(self);
+    pattern->blend = mode;
+    pattern->alpha = alpha;
+    self->data.changed = true;
+    UNLOCK(self);
+
+    return mp_const_true;
+}
+
 /**
  * Python: tlc5947.tlc5947.set_white_balance(self, [r, g, b])
  * @param self
@@ -1244,19 +2888,14 @@ static mp_obj_t tlc5947_tlc5947_delete(mp_obj_t self_in, mp_obj_t pid_in){
 static mp_obj_t tlc5947_tlc5947_set_white_balance(mp_obj_t self_in, mp_obj_t matrix_in){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    mp_obj_t *items;
-    mp_obj_get_array_fixed_n(matrix_in, 3, &items);
-
-    for(uint32_t i = 0; i < 3; ++i){
-        mp_float_t f;
-        if(mp_obj_get_float_maybe(items[i], &f)){
-            self->white_m[i] = clamp(((float)f), 0.0F, 1.0F);
-        }else{
-            // failed to get float
-            default_white_balance(self->white_m);
-            mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
-        }
+    if(!get_white_balance(matrix_in, self->white_m)){
+        // failed to get float
+        default_white_balance(self->white_m);
+        update_calibration(self);
+        mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
     }
+
+    update_calibration(self);
     return mp_const_none;
 }
 
@@ -1268,29 +2907,330 @@ static mp_obj_t tlc5947_tlc5947_set_white_balance(mp_obj_t self_in, mp_obj_t mat
 static mp_obj_t tlc5947_tlc5947_set_gamut(mp_obj_t self_in, mp_obj_t matrix_in){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    mp_obj_t *items;
-    mp_obj_get_array_fixed_n(matrix_in, 3, &items);
+    if(!get_gamut_matrix(matrix_in, self->gamut_m)){
+        // failed to get float
+        default_gamut_matrix(self->gamut_m);
+        update_calibration(self);
+        mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+    }
 
-    for(uint32_t i = 0; i < 3; ++i){
-        mp_obj_t *sub_items;
-        mp_obj_get_array_fixed_n(items[i], 3, &sub_items);
+    if(!gamut_matrix_valid(self->gamut_m)){
+        default_gamut_matrix(self->gamut_m);
+        update_calibration(self);
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid matrix"));
+    }
 
-        for(uint32_t j = 0; j < 3; ++j){
+    update_calibration(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.set_profile(self, profile, white_balance, gamut=None)
+ * @param self
+ * @param profile       profile number 1 -> PROFILES-1
+ * @param white_balance white balance matrix [r, g, b]
+ * @param gamut         gamut matrix [3x3], no gamut correction if omitted
+ */
+static mp_obj_t tlc5947_tlc5947_set_profile(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    int profile = mp_obj_get_int(args[1]);
+    if((profile <= 0) || (profile >= TLC5947_PROFILES))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid profile"));
+
+    white_balance_matrix white_m;
+    gamut_matrix gamut_m;
+    default_gamut_matrix(gamut_m);
+
+    if(!get_white_balance(args[2], white_m))
+        mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+
+    if((n_args == 4) && (args[3] != mp_const_none)){
+        if(!get_gamut_matrix(args[3], gamut_m))
+            mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+        if(!gamut_matrix_valid(gamut_m))
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid matrix"));
+    }
+
+    color_matrix_set(self->profiles[profile], white_m, gamut_m);
+    recalibrate(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.assign_profile(self, led, profile)
+ * @param self
+ * @param led     led or led's to assign the profile to
+ * @param profile profile number 0 -> PROFILES-1
+ */
+static mp_obj_t tlc5947_tlc5947_assign_profile(mp_obj_t self_in, mp_obj_t led_in, mp_obj_t profile_in){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    int profile = mp_obj_get_int(profile_in);
+    if((profile < 0) || (profile >= TLC5947_PROFILES))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid profile"));
+
+    size_t len;
+    uint16_t* leds = get_leds(self, led_in, &len);
+
+    for(size_t i = 0; i < len; i++)
+        self->profile[leds[i]] = profile;
+
+    m_free(leds);
+    recalibrate(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.master(self[, level])
+ * @param self
+ * @param level master brightness 0 -> 1, returns the current level if omitted
+ */
+static mp_obj_t tlc5947_tlc5947_master(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if(n_args == 1)
+        return mp_obj_new_float(self->master.level / 4095.0F);
+
+    mp_float_t f;
+    if(!mp_obj_get_float_maybe(args[1], &f))
+        mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+
+    uint16_t level = (uint16_t)(clamp(((float)f), 0.0F, 1.0F) * 4095.0F + 0.5F);
+    if(level == self->master.level)
+        return mp_const_none;
+
+    // the new table is built in the unused half while the frames still use the old one
+    uint16_t* lut = NULL;
+    if(level != 4095){
+        if(!self->master.tables)
+            self->master.tables = m_malloc(sizeof(uint16_t) * 2 * 4096);
+        lut = self->master.tables;
+        if(self->master.lut == lut)
+            lut += 4096;
+        for(uint32_t i = 0; i < 4096; i++)
+            lut[i] = ((i << 4) * level + 2047) / 4095;
+    }
+
+    LOCK(self);
+    self->master.lut = lut;
+    self->master.level = level;
+    recalibrate(self);
+    UNLOCK(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.dither(self[, enable])
+ * @param self
+ * @param enable enable or disable temporal dithering, returns the current state if omitted
+ */
+static mp_obj_t tlc5947_tlc5947_dither(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if(n_args == 1)
+        return mp_obj_new_bool(self->dither.error != NULL);
+
+    bool enable = mp_obj_is_true(args[1]);
+    if(enable == (self->dither.error != NULL))
+        return mp_const_none;
+
+    uint8_t (*error)[3] = NULL;
+    if(enable){
+        error = m_malloc(sizeof(*error) * self->leds);
+        memset(error, 0, sizeof(*error) * self->leds);
+    }
+
+    LOCK(self);
+    m_free(self->dither.error);
+    self->dither.error = error;
+    recalibrate(self);
+    UNLOCK(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.power_limit(self, max_current, channel_current)
+ * @param self
+ * @param max_current     current budget of all led's, None to disable the limit
+ * @param channel_current current of a single channel at full duty cycle (same unit)
+ */
+static mp_obj_t tlc5947_tlc5947_power_limit(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    uint32_t budget = 0;
+    if(args[1] != mp_const_none){
+        if(n_args != 3)
+            mp_raise_TypeError(MP_ERROR_TEXT("channel_current required"));
+
+        mp_float_t max_current, channel_current;
+        if(!mp_obj_get_float_maybe(args[1], &max_current) ||
+           !mp_obj_get_float_maybe(args[2], &channel_current))
+            mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+        if((max_current <= 0) || (channel_current <= 0))
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid current"));
+
+        // the budget is a sum of duty cycles, 4095 is one channel at full duty cycle
+        float b = ((float)max_current / (float)channel_current) * 4095.0F;
+        if(b < (3.0F * 4095.0F * self->leds)) // otherwise it can never be exceeded
+            budget = (b < 1.0F) ? 1 : (uint32_t)b;
+    }
+
+    LOCK(self);
+    self->power.budget = budget;
+    self->data.changed = true;
+    UNLOCK(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.curve(self, curve)
+ * @param self
+ * @param curve LOG, LINEAR, CIE1931, GAMMA22, GAMMA28 or a list of
+ *              at least 2 numbers 0 -> 1, sampled from brightness 0 -> 1
+ */
+static mp_obj_t tlc5947_tlc5947_curve(mp_obj_t self_in, mp_obj_t curve_in){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    const uint16_t* curve;
+    uint16_t* user_curve = NULL;
+
+    if(mp_obj_is_int(curve_in)){
+        curve = brightness_curve(mp_obj_get_int(curve_in));
+        if(!curve)
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid curve"));
+    }else{
+        mp_obj_t *items;
+        size_t len;
+        mp_obj_get_array(curve_in, &len, &items);
+        if(len < 2)
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid curve"));
+
+        float* points = m_malloc(sizeof(float) * len);
+        for(size_t i = 0; i < len; i++){
             mp_float_t f;
-            if(mp_obj_get_float_maybe(items[i], &f)){
-                self->gamut_m[i][j] = clamp(((float)f), 0.0F, 1.0F);
-            }else{
-                // failed to get float
-                default_gamut_matrix(self->gamut_m);
+            if(!mp_obj_get_float_maybe(items[i], &f)){
+                m_free(points);
                 mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
             }
+            points[i] = clamp(((float)f), 0.0F, 1.0F);
         }
+
+        // resample the points into a dense table
+        user_curve = m_malloc(sizeof(uint16_t) * CURVE_SIZE);
+        for(size_t i = 0; i < CURVE_SIZE; i++){
+            float x = (float)(i * (len - 1)) / (CURVE_SIZE - 1);
+            size_t j = (size_t)x;
+            float y = (j < (len - 1)) ? (points[j] + (points[j + 1] - points[j]) * (x - j)) : points[len - 1];
+            user_curve[i] = (uint16_t)(y * 32768.0F + 0.5F);
+        }
+        m_free(points);
+        curve = user_curve;
     }
 
-    if(!gamut_matrix_valid(self->gamut_m)){
-        default_gamut_matrix(self->gamut_m);
-        mp_raise_ValueError(MP_ERROR_TEXT("invalid matrix"));
+    LOCK(self);
+    m_free(self->user_curve);
+    self->user_curve = user_curve;
+    self->curve = curve;
+
+    // the new curve also applies to the patterns that are already running
+    for(uint16_t i = 0; i < self->data.patterns.len; i++){
+        pattern_base_t* pattern = &self->data.patterns.list[i];
+        pattern->color = rgb12_brightness(pattern->base_color, pattern->brightness, self->curve);
     }
+    self->data.changed = true;
+    UNLOCK(self);
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.freq(self[, hz])
+ * @param self
+ * @param hz rate __call__ is called at, used for delays in milliseconds,
+ *           returns the current rate if omitted
+ */
+static mp_obj_t tlc5947_tlc5947_freq(size_t n_args, const mp_obj_t *args){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if(n_args == 1)
+        return mp_obj_new_float((mp_float_t)self->freq.mhz / 1000.0F);
+
+    // an integer rate is taken exactly, a float is rounded to 1mHz
+    uint32_t mhz = 0;
+    mp_int_t i;
+    mp_float_t f;
+    if(mp_obj_get_int_maybe(args[1], &i)){
+        if((i > 0) && (i <= 1000000))
+            mhz = i * 1000U;
+    }else if(mp_obj_get_float_maybe(args[1], &f)){
+        float hz = (float)f;
+        if((hz > 0.0F) && (hz <= 1000000.0F))
+            mhz = (uint32_t)(hz * 1000.0F + 0.5F);
+    }else{
+        mp_raise_TypeError(MP_ERROR_TEXT("can't convert to float"));
+    }
+
+    if(!mhz)
+        mp_raise_ValueError(MP_ERROR_TEXT("freq out of range"));
+
+    self->freq.mhz = mhz;
+
+    return mp_const_none;
+}
+
+/**
+ * Python: tlc5947.tlc5947.define(self, name, pattern)
+ * @param self
+ * @param name    name of the subroutine, lower case letters, digits and _
+ * @param pattern the pattern that is executed by ^name
+ */
+static mp_obj_t tlc5947_tlc5947_define(mp_obj_t self_in, mp_obj_t name_in, mp_obj_t pattern_in){
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    qstr name = mp_obj_str_get_qstr(name_in);
+    const char* n = qstr_str(name);
+    if(!*n)
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid subroutine name"));
+    for(; *n; n++)
+        if(!isname(*n))
+            mp_raise_ValueError(MP_ERROR_TEXT("invalid subroutine name"));
+
+    subroutine_t sub;
+    size_t len;
+    sub.name   = name;
+    sub.tokens = compile_pattern(self, mp_obj_str_get_str(pattern_in), &len, &sub, NULL, NULL);
+    sub.len    = len;
+
+    /**
+     * The patterns that already call the old subroutine keep using its tokens,
+     * so they are not freed, the table is only read by the compiler.
+     */
+    subroutine_t* old = (subroutine_t*)find_subroutine(self, name);
+    if(old){
+        *old = sub;
+        return mp_const_none;
+    }
+
+    if(self->subroutines.len == 0xFFFF){
+        m_free(sub.tokens);
+        mp_raise_ValueError(MP_ERROR_TEXT("too many subroutines"));
+    }
+
+    subroutine_t* list = m_realloc_maybe(self->subroutines.list,
+                                         sizeof(subroutine_t) * (self->subroutines.len + 1), true);
+    if(!list){
+        m_free(sub.tokens);
+        m_malloc_fail(sizeof(subroutine_t) * (self->subroutines.len + 1));
+    }
+    list[self->subroutines.len++] = sub;
+    self->subroutines.list = list;
 
     return mp_const_none;
 }
@@ -1303,21 +3243,21 @@ static mp_obj_t tlc5947_tlc5947_set_gamut(mp_obj_t self_in, mp_obj_t matrix_in){
 static mp_obj_t tlc5947_tlc5947_set_id_map(mp_obj_t self_in, mp_obj_t map_in){
     tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(self_in);
     mp_obj_t *items;
-    mp_obj_get_array_fixed_n(map_in, 8, &items);
+    mp_obj_get_array_fixed_n(map_in, self->leds, &items);
 
-    for(uint32_t i = 0; i < 8; i++){
+    for(uint32_t i = 0; i < self->leds; i++){
         int j;
         if(mp_obj_get_int_maybe(items[i], &j)){
-            if((j >= 0) && (j <= 8)){
+            if((j >= 0) && (j < self->leds)){
                 self->id_map[i] = j;
             }else if(j == -1){
-                self->id_map[i] = 0xFF;
+                self->id_map[i] = 0xFFFF;
             }else{
                 mp_raise_ValueError(MP_ERROR_TEXT("led out of range"));
             }
         }else{
             // failed to get int
-            for(uint32_t k = 0; k < 8; k++)
+            for(uint32_t k = 0; k < self->leds; k++)
                 self->id_map[k] = k;
             mp_raise_TypeError(MP_ERROR_TEXT("can't convert to int"));
         }
@@ -1325,10 +3265,213 @@ static mp_obj_t tlc5947_tlc5947_set_id_map(mp_obj_t self_in, mp_obj_t map_in){
     return mp_const_none;
 }
 
+/**
+ * Python: tlc5947.tlc5947.set_matrix(self, width, height, serpentine=False, origin=TOP_LEFT, rotation=0)
+ * @param self
+ * @param width      number of led's per row of the panel
+ * @param height     number of rows of the panel
+ * @param serpentine every other row runs in the opposite direction
+ * @param origin     corner of the panel where led 0 is located
+ * @param rotation   rotation of the (x, y) coordinates in degrees (0, 90, 180, 270)
+ */
+static mp_obj_t tlc5947_tlc5947_set_matrix(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args){
+    enum { ARG_width, ARG_height, ARG_serpentine, ARG_origin, ARG_rotation };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_width,      MP_ARG_REQUIRED | MP_ARG_INT, {.u_int  = 0    } },
+        { MP_QSTR_height,     MP_ARG_REQUIRED | MP_ARG_INT, {.u_int  = 0    } },
+        { MP_QSTR_serpentine, MP_ARG_BOOL,                  {.u_bool = false} },
+        { MP_QSTR_origin,     MP_ARG_INT,                   {.u_int  = 0    } },
+        { MP_QSTR_rotation,   MP_ARG_INT,                   {.u_int  = 0    } },
+    };
+
+    tlc5947_tlc5947_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    int width    = args[ARG_width].u_int;
+    int height   = args[ARG_height].u_int;
+    int origin   = args[ARG_origin].u_int;
+    int rotation = args[ARG_rotation].u_int;
+
+    // each side is checked first, so the product can't overflow
+    if((width <= 0) || (height <= 0) || (width > self->leds) || (height > self->leds) ||
+       (((uint32_t)width * (uint32_t)height) > self->leds))
+        mp_raise_ValueError(MP_ERROR_TEXT("matrix larger than chain"));
+    if((origin < 0) || (origin > 3))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid origin"));
+    if((rotation % 90) || (rotation < 0) || (rotation > 270))
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid rotation"));
+
+    // rotating by 90 or 270 degrees swaps the logical width and height
+    bool swap = (rotation == 90) || (rotation == 270);
+    uint16_t lwidth  = swap ? height : width;
+    uint16_t lheight = swap ? width  : height;
+
+    uint16_t* map = m_malloc(sizeof(uint16_t) * (size_t)width * (size_t)height);
+
+    for(int y = 0; y < lheight; y++){
+        for(int x = 0; x < lwidth; x++){
+            // logical (x, y) -> physical (px, py), (0, 0) is the top left corner of the panel
+            int px, py;
+            switch(rotation){
+            case 90:  px = y;             py = height - 1 - x; break;
+            case 180: px = width - 1 - x; py = height - 1 - y; break;
+            case 270: px = width - 1 - y; py = x;              break;
+            default:  px = x;             py = y;              break;
+            }
+
+            // physical (px, py) -> position along the chain
+            if(origin & 1) // right
+                px = width - 1 - px;
+            if(origin & 2) // bottom
+                py = height - 1 - py;
+            if(args[ARG_serpentine].u_bool && (py & 1))
+                px = width - 1 - px;
+
+            map[y * lwidth + x] = py * width + px;
+        }
+    }
+
+    if(self->matrix.map)
+        m_free(self->matrix.map);
+    self->matrix.map    = map;
+    self->matrix.width  = lwidth;
+    self->matrix.height = lheight;
+
+    return mp_const_none;
+}
+
+
+/**
+ * Python: tlc5947.Program.__str__(self)
+ * @param self
+ */
+static void tlc5947_program_print(const mp_print_t *print,
+                                  mp_obj_t self_in, mp_print_kind_t kind){
+    tlc5947_program_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "Program(len=%d)", self->len);
+}
+
+/**
+ * returns true if a placeholder of the program changes the timing,
+ * the timing of such a template is only known once it is set
+ */
+static bool program_timed(const tlc5947_program_obj_t* program){
+    for(uint16_t i = 0; i < program->slots.len; i++){
+        token_type_t type = program->tokens[program->slots.list[i].pos].type;
+        if((type == pSLEEP) || (type == pPUSH))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Python: tlc5947.Program.duration, .infinite, .max_steps_per_tick
+ * @param self
+ */
+static void tlc5947_program_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest){
+    tlc5947_program_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if(dest[0] != MP_OBJ_NULL)
+        return; // read only
+
+    switch(attr){
+    case MP_QSTR_duration:
+        dest[0] = (self->info.result == PATTERN_FINITE) ?
+                  mp_obj_new_int_from_ull(self->info.duration) : mp_const_none;
+        break;
+    case MP_QSTR_infinite:
+        dest[0] = (self->info.result == PATTERN_UNKNOWN) ?
+                  mp_const_none : mp_obj_new_bool(self->info.result == PATTERN_INFINITE);
+        break;
+    case MP_QSTR_max_steps_per_tick:
+        dest[0] = (program_timed(self) || (self->info.result == PATTERN_UNKNOWN)) ?
+                  mp_const_none : mp_obj_new_int_from_ull(self->info.max_steps);
+        break;
+    default:
+        break;
+    }
+}
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    tlc5947_program_type,
+    MP_QSTR_Program,
+    MP_TYPE_FLAG_NONE,
+    print, tlc5947_program_print,
+    attr, tlc5947_program_attr
+    );
+
+/**
+ * Python: tlc5947.compile(pattern, tlc=None)
+ * @param pattern
+ * @param tlc tlc5947 object, the pattern can call its subroutines
+ * @return Program that can be passed to set() and replace()
+ */
+static mp_obj_t tlc5947_compile(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args){
+    enum { ARG_pattern, ARG_tlc };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_pattern, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_tlc,     MP_ARG_OBJ,                   {.u_obj = mp_const_none} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const char* pattern_str = mp_obj_str_get_str(args[ARG_pattern].u_obj);
+
+    const tlc5947_tlc5947_obj_t* tlc = NULL;
+    if(args[ARG_tlc].u_obj != mp_const_none){
+        if(!mp_obj_is_type(args[ARG_tlc].u_obj, &tlc5947_tlc5947_type))
+            mp_raise_TypeError(MP_ERROR_TEXT("tlc must be a tlc5947 object"));
+        tlc = MP_OBJ_TO_PTR(args[ARG_tlc].u_obj);
+    }
+
+    size_t len;
+    template_slot_t* slots;
+    size_t slots_len;
+    token_t* tokens = compile_pattern(tlc, pattern_str, &len, NULL, &slots, &slots_len);
+
+    tlc5947_program_obj_t* program = mp_obj_malloc(tlc5947_program_obj_t, &tlc5947_program_type);
+    program->len        = len;
+    program->tokens     = tokens;
+    program->slots.list = slots;
+    program->slots.len  = slots_len;
+    if(program_timed(program)){
+        memset(&program->info, 0, sizeof(program->info));
+        program->info.result = PATTERN_UNKNOWN;
+    }else{
+        analyze_pattern(tokens, len, tlc ? tlc->freq.mhz : TLC5947_FREQ_MHZ, &program->info);
+    }
+
+    return MP_OBJ_FROM_PTR(program);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(tlc5947_compile_obj, 1, tlc5947_compile);
+
+
+/**
+ * Python: tlc5947.kelvin(kelvin)
+ * @param kelvin color temperature, 1000 -> 20000
+ * @return (r, g, b) 12bit color
+ */
+static mp_obj_t tlc5947_kelvin(mp_obj_t kelvin_in){
+    int kelvin = mp_obj_get_int(kelvin_in);
+    rgb12 c = kelvintorgb12(kelvin < 0 ? 0 : kelvin);
+
+    mp_obj_t items[3] = {
+        MP_OBJ_NEW_SMALL_INT(c.r),
+        MP_OBJ_NEW_SMALL_INT(c.g),
+        MP_OBJ_NEW_SMALL_INT(c.b),
+    };
+    return mp_obj_new_tuple(3, items);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(tlc5947_kelvin_obj, tlc5947_kelvin);
+
 
 static const mp_rom_map_elem_t tlc5947_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_tlc5947)      },
     { MP_ROM_QSTR(MP_QSTR_tlc5947),  MP_ROM_PTR(&tlc5947_tlc5947_type) },
+    { MP_ROM_QSTR(MP_QSTR_kelvin),   MP_ROM_PTR(&tlc5947_kelvin_obj)   },
+    { MP_ROM_QSTR(MP_QSTR_compile),  MP_ROM_PTR(&tlc5947_compile_obj)  },
+    { MP_ROM_QSTR(MP_QSTR_Program),  MP_ROM_PTR(&tlc5947_program_type) },
 };
 
 static MP_DEFINE_CONST_DICT(
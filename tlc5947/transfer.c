@@ -0,0 +1,121 @@
+/**
+ * @file   tlc5947-rgb-micropython/tlc5947/transfer.c
+ * @author Peter Züger
+ * @date   16.10.2026
+ * @brief  tlc5947 asynchronous spi transfer
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Peter Züger
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "py/mpconfig.h"
+
+#if defined(MODULE_TLC5947_ENABLED) && MODULE_TLC5947_ENABLED == 1
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mphal.h"
+
+#include "transfer.h"
+
+#if MODULE_TLC5947_DMA
+
+static void transfer_complete(DMA_HandleTypeDef* hdma){
+    transfer_t* t = (transfer_t*)((uint8_t*)hdma - offsetof(transfer_t, dma));
+
+    // let the HAL finish the spi transaction, this waits until the last bit is shifted out
+    t->cplt(hdma);
+
+    dma_deinit(t->spi->tx_dma_descr);
+    t->busy = false;
+
+    if(t->done)
+        t->done(t->arg);
+}
+
+void transfer_init(transfer_t* t, mp_obj_t spi, transfer_done_t done, void* arg){
+    memset(t, 0, sizeof(transfer_t));
+    t->done = done;
+    t->arg  = arg;
+
+    // only the hardware spi peripherals can use DMA, everything else falls back to blocking
+    nlr_buf_t nlr;
+    if(nlr_push(&nlr) == 0){
+        t->spi = spi_from_mp_obj(spi);
+        nlr_pop();
+    }else{
+        t->spi = NULL;
+    }
+}
+
+bool transfer_start(transfer_t* t, const uint8_t* buf, size_t len){
+    if(!t->spi || !t->spi->tx_dma_descr || (len > 0xFFFF))
+        return false;
+
+    t->busy = true;
+
+    dma_init(&t->dma, t->spi->tx_dma_descr, DMA_MEMORY_TO_PERIPH, t->spi->spi);
+    t->spi->spi->hdmatx = &t->dma;
+    t->spi->spi->hdmarx = NULL;
+
+#if defined(MP_HAL_CLEAN_DCACHE)
+    MP_HAL_CLEAN_DCACHE(buf, len);
+#endif
+
+    /**
+     * The DMA interrupt has a higher priority than the timer calling us,
+     * so the interrupts are disabled until the complete callback is hooked.
+     */
+    uint32_t irq_state = disable_irq();
+
+    if(HAL_SPI_Transmit_DMA(t->spi->spi, (uint8_t*)buf, len) != HAL_OK){
+        enable_irq(irq_state);
+        dma_deinit(t->spi->tx_dma_descr);
+        t->busy = false;
+        return false;
+    }
+
+    t->cplt = t->dma.XferCpltCallback;
+    t->dma.XferCpltCallback = transfer_complete;
+
+    enable_irq(irq_state);
+
+    return true;
+}
+
+#else /* MODULE_TLC5947_DMA */
+
+void transfer_init(transfer_t* t, mp_obj_t spi, transfer_done_t done, void* arg){
+    memset(t, 0, sizeof(transfer_t));
+    t->done = done;
+    t->arg  = arg;
+}
+
+bool transfer_start(transfer_t* t, const uint8_t* buf, size_t len){
+    return false;
+}
+
+#endif /* MODULE_TLC5947_DMA */
+
+#endif /* defined(MODULE_TLC5947_ENABLED) && MODULE_TLC5947_ENABLED == 1 */
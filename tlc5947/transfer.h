@@ -0,0 +1,93 @@
+/**
+ * @file   tlc5947-rgb-micropython/tlc5947/transfer.h
+ * @author Peter Züger
+ * @date   16.10.2026
+ * @brief  tlc5947 asynchronous spi transfer
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Peter Züger
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TLC5947_TRANSFER_H
+#define TLC5947_TRANSFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "py/obj.h"
+
+/**
+ * DMA transfers are only implemented for the stm32 port,
+ * all other ports use the blocking spi protocol transfer.
+ */
+#if !defined(MODULE_TLC5947_DMA)
+#if defined(STM32_HAL_H)
+#define MODULE_TLC5947_DMA 1
+#else
+#define MODULE_TLC5947_DMA 0
+#endif
+#endif
+
+#if MODULE_TLC5947_DMA
+#include "spi.h"
+#include "dma.h"
+#endif
+
+typedef void (*transfer_done_t)(void* arg);
+
+typedef struct _transfer_t{
+    volatile bool busy;       // a transfer is in progress
+    transfer_done_t done;     // called from the transfer complete interrupt
+    void* arg;                // argument for done
+#if MODULE_TLC5947_DMA
+    const spi_t* spi;         // hardware spi, NULL if DMA is not available
+    DMA_HandleTypeDef dma;    // tx DMA handle, must stay valid for the whole transfer
+    void (*cplt)(DMA_HandleTypeDef* hdma); // transfer complete callback installed by the HAL
+#endif
+}transfer_t;
+
+#if defined(__cplusplus)
+extern "C"{
+#endif /* defined(__cplusplus) */
+
+
+/**
+ * initializes the transfer for the given spi object,
+ * done(arg) is called once an asynchronous transfer is complete.
+ */
+void transfer_init(transfer_t* t, mp_obj_t spi, transfer_done_t done, void* arg);
+
+/**
+ * starts shifting out len bytes from buf in the background,
+ * buf must stay valid until the transfer is complete.
+ * returns false if no asynchronous transfer is possible,
+ * in that case the caller has to fall back to a blocking transfer.
+ */
+bool transfer_start(transfer_t* t, const uint8_t* buf, size_t len);
+
+#if defined(__cplusplus)
+}
+#endif /* defined(__cplusplus) */
+
+#endif /* TLC5947_TRANSFER_H */